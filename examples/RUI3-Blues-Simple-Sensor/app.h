@@ -65,6 +65,8 @@ bool get_at_setting(void);
 bool save_at_setting(void);
 bool read_blues_settings(void);
 bool save_blues_settings(void);
+bool read_blues_config(void);
+bool save_blues_config(void);
 
 // Cayenne LPP Channel numbers per sensor value
 #define LPP_CHANNEL_BATT 1			   // Base Board
@@ -136,5 +138,6 @@ bool blues_send_payload(uint8_t *data, uint16_t data_len);
 void blues_card_restore(void);
 extern RAK_BLUES rak_blues;
 extern s_blues_settings g_blues_settings;
+extern blues_config_state g_blues_config;
 extern bool has_blues;
 extern char rsp_msg[];
@@ -24,8 +24,59 @@ char rsp_msg[1024];
 /** Flag if the Blues Notecard is available */
 bool has_blues = false;
 
+/** Last applied NoteCard settings, saved in flash */
+blues_config_state g_blues_config;
+
+/** RAM for the cached responses, one per cached request */
+blues_cache_entry g_blues_cache[3];
+
+/**
+ * @brief Body of the sensor notes, sent as note.template for compact notes
+ *
+ */
+static const blues_template_field data_fields[] = {
+	{"dev_eui", BLUES_FIELD_STRING, 16},
+	{"temp", BLUES_FIELD_FLOAT, 4},
+	{"humid", BLUES_FIELD_FLOAT, 4},
+	{"baro", BLUES_FIELD_FLOAT, 4}};
+
+/**
+ * @brief Setting slots of the configuration manager, must stay the same between firmware versions
+ *
+ */
+enum blues_cfg_slots
+{
+	CFG_LOCATION_MODE = 0,
+	CFG_LOCATION_TRACK,
+	CFG_MOTION_MODE,
+	CFG_MOTION_SYNC,
+	CFG_MOTION_TRACK,
+	CFG_HUB_SET,
+	CFG_CARD_WIRELESS
+};
+
+/**
+ * @brief Callback for the responses of the setup batch
+ *
+ * @param idx index of the request in the batch
+ * @param success true if the request succeeded
+ */
+void blues_setup_cb(uint8_t idx, bool success)
+{
+	if (success)
+	{
+		serializeJson(rak_blues.note_json, rsp_msg, 1024);
+		MYLOG("BLUES", "Setup request %d: %s", idx, rsp_msg);
+	}
+	else
+	{
+		MYLOG("BLUES", "Setup request %d failed %s", idx, rak_blues.get_last_err_str());
+	}
+}
+
 /**
  * @brief Initialize Blues NoteCard
+ * 		Only settings that changed since the last boot are sent, as one batch
  *
  * @return true if NoteCard was found and setup was successful
  * @return false if NoteCard was not found or the setup failed
@@ -33,87 +84,55 @@ bool has_blues = false;
 bool init_blues(void)
 {
 	Wire.begin();
-	Wire.setClock(100000);
+
+	// Get the last applied settings, checks the NoteCard with card.version
+	// The fastest working I2C clock is negotiated and saved with the settings
+	read_blues_config();
+	if (!rak_blues.config_begin(&g_blues_config))
+	{
+		MYLOG("BLUES", "NoteCard not found");
+		return false;
+	}
 
 	/*******************************************************************************/
 	/** Reset all location and motion modes to non-active, just in case            */
+	/** Sent as requests, only a response confirms that a setting was applied      */
 	/*******************************************************************************/
 	// Disable location (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.location.mode"))
 	{
-		if (rak_blues.start_req((char *)"card.location.mode"))
-		{
-			rak_blues.add_string_entry((char *)"mode", (char *)"off");
-			if (rak_blues.send_req(rsp_msg, 1024))
-			{
-				MYLOG("BLUES", "card.location.mode: %s", rsp_msg);
-				break;
-			}
-		}
-		else
-		{
-			MYLOG("BLUES", "Could not create request for card.location.mode");
-		}
+		rak_blues.add_string_entry((char *)"mode", (char *)"off");
+		rak_blues.config_add(CFG_LOCATION_MODE, (char *)"card.location.mode");
 	}
 
 	// Disable location tracking (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.location.track"))
 	{
-		if (rak_blues.start_req((char *)"card.location.track"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req(rsp_msg, 1024))
-			{
-				MYLOG("BLUES", "card.location.track: %s", rsp_msg);
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_LOCATION_TRACK);
 	}
 
 	// Disable motion mode (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.motion.mode"))
 	{
-		if (rak_blues.start_req((char *)"card.motion.mode"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req(rsp_msg, 1024))
-			{
-				MYLOG("BLUES", "card.motion.mode: %s", rsp_msg);
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_MOTION_MODE);
 	}
 
 	// Disable motion sync (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.motion.sync"))
 	{
-		if (rak_blues.start_req((char *)"card.motion.sync"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req(rsp_msg, 1024))
-			{
-				MYLOG("BLUES", "card.motion.sync: %s", rsp_msg);
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_MOTION_SYNC);
 	}
 
 	// Disable motion tracking (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.motion.track"))
 	{
-		if (rak_blues.start_req((char *)"card.motion.track"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req(rsp_msg, 1024))
-			{
-				MYLOG("BLUES", "card.motion.track: %s", rsp_msg);
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_MOTION_TRACK);
 	}
 
-	bool request_success = false;
-
 	// Get the ProductUID from the saved settings
 	// If no settings are found, use NoteCard internal settings!
 	if (read_blues_settings())
@@ -128,107 +147,81 @@ bool init_blues(void)
 		}
 
 		MYLOG("BLUES", "Set Product ID and connection mode");
-		for (int try_send = 0; try_send < 3; try_send++)
+		// Retries are handled by the library
+		if (rak_blues.start_req((char *)"hub.set"))
 		{
-			if (rak_blues.start_req((char *)"hub.set"))
+			rak_blues.add_string_entry((char *)"product", g_blues_settings.product_uid);
+			if (g_blues_settings.conn_continous)
 			{
-				rak_blues.add_string_entry((char *)"product", g_blues_settings.product_uid);
-				if (g_blues_settings.conn_continous)
-				{
-					rak_blues.add_string_entry((char *)"mode", (char *)"continuous");
-				}
-				else
-				{
-					rak_blues.add_string_entry((char *)"mode", (char *)"minimum");
-				}
-				// Set sync time to the sensor read time
-				rak_blues.add_int32_entry((char *)"seconds", (g_send_repeat_time / 1000));
-				rak_blues.add_bool_entry((char *)"heartbeat", true);
-
-				if (rak_blues.send_req(rsp_msg, 1024))
-				{
-					request_success = true;
-					MYLOG("BLUES", "hub.set: %s", rsp_msg);
-					break;
-				}
+				rak_blues.add_string_entry((char *)"mode", (char *)"continuous");
 			}
-			delay(100);
-		}
-		if (!request_success)
-		{
-			MYLOG("BLUES", "hub.set request failed");
-			return false;
+			else
+			{
+				rak_blues.add_string_entry((char *)"mode", (char *)"minimum");
+			}
+			// Set sync time to the sensor read time
+			rak_blues.add_int32_entry((char *)"seconds", (g_send_repeat_time / 1000));
+			rak_blues.add_bool_entry((char *)"heartbeat", true);
+
+			rak_blues.config_add(CFG_HUB_SET, (char *)"hub.get");
 		}
-		request_success = false;
 
 		MYLOG("BLUES", "Set SIM and APN");
-		for (int try_send = 0; try_send < 3; try_send++)
+		if (rak_blues.start_req((char *)"card.wireless"))
 		{
-			if (rak_blues.start_req((char *)"card.wireless"))
+			rak_blues.add_string_entry((char *)"mode", (char *)"auto");
+
+			switch (g_blues_settings.sim_usage)
 			{
-				rak_blues.add_string_entry((char *)"mode", (char *)"auto");
-
-				switch (g_blues_settings.sim_usage)
-				{
-				case 0:
-					// USING BLUES eSIM CARD
-					rak_blues.add_string_entry((char *)"method", (char *)"primary");
-					break;
-				case 1:
-					// USING EXTERNAL SIM CARD only
-					rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
-					rak_blues.add_string_entry((char *)"method", (char *)"secondary");
-					break;
-				case 2:
-					// USING EXTERNAL SIM CARD as primary
-					rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
-					rak_blues.add_string_entry((char *)"method", (char *)"dual-secondary-primary");
-					break;
-				case 3:
-					// USING EXTERNAL SIM CARD as secondary
-					rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
-					rak_blues.add_string_entry((char *)"method", (char *)"dual-primary-secondary");
-					break;
-				}
-
-				if (rak_blues.send_req(rsp_msg, 1024))
-				{
-					request_success = true;
-					MYLOG("BLUES", "card.wireless: %s", rsp_msg);
-					break;
-				}
+			case 0:
+				// USING BLUES eSIM CARD
+				rak_blues.add_string_entry((char *)"method", (char *)"primary");
+				break;
+			case 1:
+				// USING EXTERNAL SIM CARD only
+				rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
+				rak_blues.add_string_entry((char *)"method", (char *)"secondary");
+				break;
+			case 2:
+				// USING EXTERNAL SIM CARD as primary
+				rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
+				rak_blues.add_string_entry((char *)"method", (char *)"dual-secondary-primary");
+				break;
+			case 3:
+				// USING EXTERNAL SIM CARD as secondary
+				rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
+				rak_blues.add_string_entry((char *)"method", (char *)"dual-primary-secondary");
+				break;
 			}
-		}
-		if (!request_success)
-		{
-			MYLOG("BLUES", "card.wireless request failed");
-			return false;
+
+			rak_blues.config_add(CFG_CARD_WIRELESS, (char *)"card.wireless");
 		}
 	}
-	request_success = false;
 
-	for (int try_send = 0; try_send < 3; try_send++)
+	// Send the changed settings in one pass, hub.set and card.wireless must succeed
+	bool setup_success = rak_blues.config_apply(blues_setup_cb);
+	if (rak_blues.config_changed())
 	{
-		if (rak_blues.start_req((char *)"card.version"))
-		{
-			if (rak_blues.send_req(rsp_msg, 1024))
-			{
-				MYLOG("BLUES", "card.version: %s", rsp_msg);
-				request_success = true;
-				break;
-			}
-			else
-			{
-				MYLOG("BLUES", "Send request failed");
-			}
-		}
-		else
-		{
-			MYLOG("BLUES", "Start request failed");
-		}
+		save_blues_config();
+	}
+	if (!setup_success)
+	{
+		MYLOG("BLUES", "Setup failed %s", rak_blues.get_last_err_str());
+		return false;
 	}
 
-	return request_success;
+	// Sync at the latest 1 hour after the first note or when 10 notes are waiting
+	rak_blues.sync_begin(3600, 10);
+
+	// Sensor notes are stored in compact form, the CayenneLPP payload has max 64 bytes
+	rak_blues.template_add((char *)"data.qo", data_fields, 4, 64);
+
+	// Status queries change rarely, repeated queries are answered from RAM
+	rak_blues.cache_begin(g_blues_cache, 3);
+	rak_blues.cache_add((char *)"card.version", 0);
+	rak_blues.cache_add((char *)"hub.get", 0);
+	rak_blues.cache_add((char *)"hub.status", 10);
+	return true;
 }
 
 /**
@@ -241,47 +234,41 @@ bool init_blues(void)
  */
 bool blues_send_payload(uint8_t *data, uint16_t data_len)
 {
-	char payload_b86[255];
 	bool request_success = false;
 
-	for (int try_send = 0; try_send < 3; try_send++)
+	// note.add is not idempotent, a retry after delivery would create a duplicate note
+	if (rak_blues.start_req((char *)"note.add", false))
 	{
-		if (rak_blues.start_req((char *)"note.add"))
-		{
-			rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
-			rak_blues.add_bool_entry((char *)"sync", true);
-			char node_id[24];
-			uint8_t node_device_eui[8];
-			api.lorawan.deui.get(node_device_eui, 8);
-			sprintf(node_id, "%02x%02x%02x%02x%02x%02x%02x%02x",
-					node_device_eui[0], node_device_eui[1],
-					node_device_eui[2], node_device_eui[3],
-					node_device_eui[4], node_device_eui[5],
-					node_device_eui[6], node_device_eui[7]);
-			rak_blues.add_nested_string_entry((char *)"body", (char *)"dev_eui", node_id);
-			rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", bme680_temp);
-			rak_blues.add_nested_float_entry((char *)"body", (char *)"humid", bme680_humidity);
-			rak_blues.add_nested_float_entry((char *)"body", (char *)"baro", bme680_barometer);
-
-			rak_blues.myJB64Encode(payload_b86, (const char *)data, data_len);
-
-			rak_blues.add_string_entry((char *)"payload", payload_b86);
-
-			MYLOG("BLUES", "Payload prepared");
-
-			if (rak_blues.send_req())
-			{
-				request_success = true;
-				break;
-			}
-		}
+		// No "sync":true, the sync scheduler decides when to sync
+		rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
+		char node_id[24];
+		uint8_t node_device_eui[8];
+		api.lorawan.deui.get(node_device_eui, 8);
+		sprintf(node_id, "%02x%02x%02x%02x%02x%02x%02x%02x",
+				node_device_eui[0], node_device_eui[1],
+				node_device_eui[2], node_device_eui[3],
+				node_device_eui[4], node_device_eui[5],
+				node_device_eui[6], node_device_eui[7]);
+		rak_blues.add_nested_string_entry((char *)"body", (char *)"dev_eui", node_id);
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", bme680_temp);
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"humid", bme680_humidity);
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"baro", bme680_barometer);
+
+		// Payload is Base64 encoded when the request is sent
+		rak_blues.add_payload_entry(data, data_len);
+
+		MYLOG("BLUES", "Payload prepared");
+
+		request_success = rak_blues.send_req();
 	}
 	if (!request_success)
 	{
-		MYLOG("BLUES", "Send request failed");
+		MYLOG("BLUES", "Send request failed %s", rak_blues.get_last_err_str());
 		return false;
 	}
 
+	// Sync with NoteHub only if the sync policy requires it
+	rak_blues.sync_process();
 	return request_success;
 }
 
@@ -295,4 +282,9 @@ void blues_card_restore(void)
 	rak_blues.add_bool_entry((char *)"delete", true);
 	rak_blues.add_bool_entry((char *)"connected", true);
 	rak_blues.send_req();
+	rak_blues.cache_invalidate();
+
+	// The settings on the NoteCard are unknown now
+	memset(&g_blues_config, 0, sizeof(blues_config_state));
+	save_blues_config();
 }
@@ -13,6 +13,7 @@
 /** Send Interval offset in flash */
 #define SEND_FREQ_OFFSET 0x00000002		 // length 4 bytes
 #define BLUES_SETTINGS_OFFSET 0x00000010 // length 518 bytes
+#define BLUES_CONFIG_OFFSET 0x00000220	 // length sizeof(blues_config_state)
 
 // Forward declarations
 int interval_send_handler(SERIAL_PORT port, char *cmd, stParam *param);
@@ -504,4 +505,42 @@ bool save_blues_settings(void)
 	}
 	MYLOG("USR_AT", "Saving Blues parameters failed");
 	return false;
+}
+
+/**
+ * @brief Read the last applied NoteCard settings from flash
+ * 		If nothing is found, the settings are unknown and will be sent to the NoteCard
+ *
+ * @return true if the settings were read
+ * @return false if the flash could not be read
+ */
+bool read_blues_config(void)
+{
+	if (api.system.flash.get(BLUES_CONFIG_OFFSET, (uint8_t *)&g_blues_config, sizeof(blues_config_state)))
+	{
+		// Erased flash is not a valid state
+		if (g_blues_config.device_hash == 0xFFFFFFFF)
+		{
+			memset(&g_blues_config, 0, sizeof(blues_config_state));
+		}
+		return true;
+	}
+	memset(&g_blues_config, 0, sizeof(blues_config_state));
+	return false;
+}
+
+/**
+ * @brief Save the last applied NoteCard settings to flash
+ *
+ * @return true if the settings were saved
+ * @return false if the flash could not be written
+ */
+bool save_blues_config(void)
+{
+	if (api.system.flash.set(BLUES_CONFIG_OFFSET, (uint8_t *)&g_blues_config, sizeof(blues_config_state)))
+	{
+		return true;
+	}
+	MYLOG("USR_AT", "Saving Blues config state failed");
+	return false;
 }
\ No newline at end of file
@@ -79,7 +79,8 @@ void setup(void)
 
 	// Initialize Blues Notecard interface
 	Wire.begin();
-	Wire.setClock(100000);
+	// 400 kHz if the wiring allows it, otherwise 100 kHz
+	rak_blues.i2c_negotiate();
 }
 
 /**
@@ -102,7 +103,8 @@ void loop()
 
 	Serial.println("======================================================");
 	// Prepare a simple data packet
-	if (rak_blues.start_req((char *)"note.add"))
+	// note.add is not idempotent, a retry after delivery would create a duplicate note
+	if (rak_blues.start_req((char *)"note.add", false))
 	{
 		// Create data file
 		rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
@@ -157,37 +159,28 @@ void loop()
  */
 bool blues_hub_connected(void)
 {
-	bool request_success = false;
 	bool cellular_connected = false;
-	for (int try_send = 0; try_send < 5; try_send++)
+	// Prepare "card.wireless" request, retries are handled by the library
+	if (rak_blues.start_req((char *)"card.wireless"))
 	{
-		// Prepare "card.wireless" request
-		if (rak_blues.start_req((char *)"card.wireless"))
+		// Send request
+		if (rak_blues.send_req())
 		{
-			// Send request
-			if (rak_blues.send_req())
+			// Check if the response has an entry "net"
+			if (rak_blues.has_entry((char *)"net"))
 			{
-				// Check if the response has an entry "net"
-				if (rak_blues.has_entry((char *)"net"))
+				// Check if the response has an entry "band"
+				if (rak_blues.has_nested_entry((char *)"net", (char *)"band"))
 				{
-					// Check if the response has an entry "band"
-					if (rak_blues.has_nested_entry((char *)"net", (char *)"band"))
-					{
-						// If "band" is available, the NoteCard should have cellular connection
-						cellular_connected = true;
-					}
-					request_success = true;
-					break;
+					// If "band" is available, the NoteCard should have cellular connection
+					cellular_connected = true;
 				}
 			}
+			return cellular_connected;
 		}
 	}
-	if (!request_success)
-	{
-		Serial.println("'card.wireless' request failed");
-		return false;
-	}
-	return cellular_connected;
+	Serial.println("'card.wireless' request failed");
+	return false;
 }
 
 /**
@@ -196,55 +189,37 @@ bool blues_hub_connected(void)
  */
 void blues_hub_status(void)
 {
-	bool request_success = false;
-	for (int try_send = 0; try_send < 3; try_send++)
+	rak_blues.start_req((char *)"hub.status");
+	if (rak_blues.send_req(blues_response, 2048))
 	{
-		rak_blues.start_req((char *)"hub.status");
-		if (rak_blues.send_req(blues_response, 2048))
-		{
-			Serial.println("Notecard Hub status:");
-			Serial.printf("%s\n", blues_response);
-			request_success = true;
-			break;
-		}
+		Serial.println("Notecard Hub status:");
+		Serial.printf("%s\n", blues_response);
 	}
-	if (!request_success)
+	else
 	{
 		Serial.println("'hub.status' request failed");
 	}
 	Serial.println("======================================================");
 
-	request_success = false;
-	for (int try_send = 0; try_send < 3; try_send++)
+	rak_blues.start_req((char *)"hub.get");
+	if (rak_blues.send_req(blues_response, 2048))
 	{
-		rak_blues.start_req((char *)"hub.get");
-		if (rak_blues.send_req(blues_response, 2048))
-		{
-			Serial.println("Notecard Hub setup:");
-			Serial.printf("%s\n", blues_response);
-			request_success = true;
-			break;
-		}
+		Serial.println("Notecard Hub setup:");
+		Serial.printf("%s\n", blues_response);
 	}
-	if (!request_success)
+	else
 	{
 		Serial.println("'hub.get' request failed");
 	}
 	Serial.println("======================================================");
 
-	request_success = false;
-	for (int try_send = 0; try_send < 3; try_send++)
+	rak_blues.start_req((char *)"card.wireless");
+	if (rak_blues.send_req(blues_response, 2048))
 	{
-		rak_blues.start_req((char *)"card.wireless");
-		if (rak_blues.send_req(blues_response, 2048))
-		{
-			Serial.println("Notecard wireless status:");
-			Serial.printf("%s\n", blues_response);
-			request_success = true;
-			break;
-		}
+		Serial.println("Notecard wireless status:");
+		Serial.printf("%s\n", blues_response);
 	}
-	if (!request_success)
+	else
 	{
 		Serial.println("'card.wireless' request failed");
 	}
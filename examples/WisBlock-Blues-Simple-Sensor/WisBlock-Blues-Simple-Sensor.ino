@@ -165,6 +165,13 @@ void app_event_handler(void)
 			read_rak1906();
 		}
 
+		if (has_blues)
+		{
+			// Both are answered locally unless a resync or a new fix is due
+			rak_blues.time_process();
+			blues_get_location();
+		}
+
 		bool check_rejoin = false;
 
 		if (g_lpwan_has_joined)
@@ -277,7 +284,8 @@ void app_event_handler(void)
 		send_counter = 0;
 		g_task_event_type &= N_USE_CELLULAR;
 
-		if (has_blues)
+		// The NoteCard was found at startup, check it is still answering without a request
+		if (has_blues && rak_blues.ping())
 		{
 			// Send over cellular connection
 			MYLOG("APP", "Get hub sync status:");
@@ -286,9 +294,11 @@ void app_event_handler(void)
 			g_solution_data.addDevID(0, &g_lorawan_settings.node_device_eui[4]);
 			blues_send_payload(g_solution_data.getBuffer(), g_solution_data.getSize());
 
-			// Request sync with NoteHub
-			rak_blues.start_req((char *)"hub.sync");
-			rak_blues.send_req();
+			// Sync with NoteHub only if the sync policy requires it
+			rak_blues.sync_process();
+
+			// Get downlinks that arrived with the last sync
+			blues_get_inbound();
 
 			if (!g_lpwan_has_joined)
 			{
@@ -311,6 +321,27 @@ void app_event_handler(void)
 			MYLOG("APP", "Skip USE_CELLULAR, no NoteCard available");
 		}
 	}
+
+	// NoteCard ATTN event
+	if ((g_task_event_type & BLUES_ATTN) == BLUES_ATTN)
+	{
+		g_task_event_type &= N_BLUES_ATTN;
+		MYLOG("APP", "NoteCard ATTN");
+
+		uint8_t events = rak_blues.attn_get_events();
+		if ((events & BLUES_ATTN_FILES) == BLUES_ATTN_FILES)
+		{
+			blues_get_inbound();
+		}
+		if ((events & BLUES_ATTN_LOCATION) == BLUES_ATTN_LOCATION)
+		{
+			// New fix, GNSS is switched off again
+			rak_blues.location_update();
+		}
+
+		// Arm ATTN for the next event
+		rak_blues.attn_arm(BLUES_ATTN_FILES | BLUES_ATTN_LOCATION, (char *)"data.qi");
+	}
 }
 
 /**
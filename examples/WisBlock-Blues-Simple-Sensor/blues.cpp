@@ -22,8 +22,54 @@ RAK_BLUES rak_blues;
 /** Flag if GNSS is in continuous or periodic mode */
 bool gnss_continuous = true;
 
+/** Last applied NoteCard settings, saved in flash */
+blues_config_state g_blues_config;
+
+/** RAM for the cached responses, one per cached request */
+blues_cache_entry g_blues_cache[3];
+
+/**
+ * @brief Body of the sensor notes, sent as note.template for compact notes
+ *
+ */
+static const blues_template_field data_fields[] = {
+	{"dev_eui", BLUES_FIELD_STRING, 16},
+	{"temp", BLUES_FIELD_FLOAT, 4},
+	{"humid", BLUES_FIELD_FLOAT, 4},
+	{"baro", BLUES_FIELD_FLOAT, 4}};
+
+/**
+ * @brief Setting slots of the configuration manager, must stay the same between firmware versions
+ *
+ */
+enum blues_cfg_slots
+{
+	CFG_HUB_SET = 0,
+	CFG_CARD_WIRELESS,
+	CFG_LOCATION_MODE,
+	CFG_LOCATION_TRACK,
+	CFG_MOTION_MODE,
+	CFG_MOTION_SYNC,
+	CFG_MOTION_TRACK
+};
+
+/**
+ * @brief Callback for the responses of the setup batch
+ *
+ * @param idx index of the request in the batch
+ * @param success true if the request succeeded
+ */
+void blues_setup_cb(uint8_t idx, bool success)
+{
+	if (!success)
+	{
+		MYLOG("BLUES", "Setup request %d failed %s", idx, rak_blues.get_last_err_str());
+	}
+}
+
 /**
  * @brief Initialize Blues NoteCard
+ * 		Only settings that changed since the last boot are sent, as one batch
  *
  * @return true if NoteCard was found and setup was successful
  * @return false if NoteCard was not found or the setup failed
@@ -31,13 +77,20 @@ bool gnss_continuous = true;
 bool init_blues(void)
 {
 	Wire.begin();
-	Wire.setClock(100000);
+
+	// Get the last applied settings, checks the NoteCard with card.version
+	// The fastest working I2C clock is negotiated and saved with the settings
+	read_blues_config();
+	if (!rak_blues.config_begin(&g_blues_config))
+	{
+		MYLOG("BLUES", "NoteCard not found");
+		return false;
+	}
+
 	// Get the ProductUID from the saved settings
 	// If no settings are found, use NoteCard internal settings!
 	if (read_blues_settings())
 	{
-		bool request_success = false;
-
 		MYLOG("BLUES", "Found saved settings, override NoteCard internal settings!");
 		if (memcmp(g_blues_settings.product_uid, "com.my-company.my-name", 22) == 0)
 		{
@@ -47,158 +100,122 @@ bool init_blues(void)
 		}
 
 		MYLOG("BLUES", "Set Product ID and connection mode");
-		for (int try_send = 0; try_send < 3; try_send++)
+		if (rak_blues.start_req((char *)"hub.set"))
 		{
-			if (rak_blues.start_req((char *)"hub.set"))
+			rak_blues.add_string_entry((char *)"product", g_blues_settings.product_uid);
+			if (g_blues_settings.conn_continous)
 			{
-				rak_blues.add_string_entry((char *)"product", g_blues_settings.product_uid);
-				if (g_blues_settings.conn_continous)
-				{
-					rak_blues.add_string_entry((char *)"mode", (char *)"continuous");
-				}
-				else
-				{
-					rak_blues.add_string_entry((char *)"mode", (char *)"minimum");
-				}
-				// // Set sync time to 20 times the sensor read time
-				// add_int32_entry((char *)"seconds", (g_lorawan_settings.send_repeat_time * 20 / 1000));
-				// add_bool_entry((char *)"heartbeat", true);
-
-				if (rak_blues.send_req())
-				{
-					request_success = true;
-					break;
-				}
+				rak_blues.add_string_entry((char *)"mode", (char *)"continuous");
 			}
-			delay(100);
-		}
-		if (!request_success)
-		{
-			MYLOG("BLUES", "hub.set request failed");
-			return false;
+			else
+			{
+				rak_blues.add_string_entry((char *)"mode", (char *)"minimum");
+			}
+			// // Set sync time to 20 times the sensor read time
+			// add_int32_entry((char *)"seconds", (g_lorawan_settings.send_repeat_time * 20 / 1000));
+			// add_bool_entry((char *)"heartbeat", true);
+
+			rak_blues.config_add(CFG_HUB_SET, (char *)"hub.get");
 		}
-		request_success = false;
 
 		MYLOG("BLUES", "Set SIM and APN");
-		for (int try_send = 0; try_send < 3; try_send++)
+		if (rak_blues.start_req((char *)"card.wireless"))
 		{
-			if (rak_blues.start_req((char *)"card.wireless"))
+			rak_blues.add_string_entry((char *)"mode", (char *)"auto");
+
+			switch (g_blues_settings.sim_usage)
 			{
-				rak_blues.add_string_entry((char *)"mode", (char *)"auto");
-
-				switch (g_blues_settings.sim_usage)
-				{
-				case 0:
-					// USING BLUES eSIM CARD
-					rak_blues.add_string_entry((char *)"method", (char *)"primary");
-					break;
-				case 1:
-					// USING EXTERNAL SIM CARD only
-					rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
-					rak_blues.add_string_entry((char *)"method", (char *)"secondary");
-					break;
-				case 2:
-					// USING EXTERNAL SIM CARD as primary
-					rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
-					rak_blues.add_string_entry((char *)"method", (char *)"dual-secondary-primary");
-					break;
-				case 3:
-					// USING EXTERNAL SIM CARD as secondary
-					rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
-					rak_blues.add_string_entry((char *)"method", (char *)"dual-primary-secondary");
-					break;
-				}
-
-				if (rak_blues.send_req())
-				{
-					request_success = true;
-					break;
-				}
+			case 0:
+				// USING BLUES eSIM CARD
+				rak_blues.add_string_entry((char *)"method", (char *)"primary");
+				break;
+			case 1:
+				// USING EXTERNAL SIM CARD only
+				rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
+				rak_blues.add_string_entry((char *)"method", (char *)"secondary");
+				break;
+			case 2:
+				// USING EXTERNAL SIM CARD as primary
+				rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
+				rak_blues.add_string_entry((char *)"method", (char *)"dual-secondary-primary");
+				break;
+			case 3:
+				// USING EXTERNAL SIM CARD as secondary
+				rak_blues.add_string_entry((char *)"apn", g_blues_settings.ext_sim_apn);
+				rak_blues.add_string_entry((char *)"method", (char *)"dual-primary-secondary");
+				break;
 			}
+
+			rak_blues.config_add(CFG_CARD_WIRELESS, (char *)"card.wireless");
 		}
-		if (!request_success)
-		{
-			MYLOG("BLUES", "card.wireless request failed");
-			return false;
-		}
-		request_success = false;
 	}
 
 	// Disable location (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.location.mode"))
 	{
-		if (rak_blues.start_req((char *)"card.location.mode"))
-		{
-			rak_blues.add_string_entry((char *)"mode", (char *)"off");
-			if (rak_blues.send_req())
-			{
-				break;
-			}
-		}
+		rak_blues.add_string_entry((char *)"mode", (char *)"off");
+		rak_blues.config_add(CFG_LOCATION_MODE, (char *)"card.location.mode");
 	}
 
 	// Disable location tracking (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.location.track"))
 	{
-		if (rak_blues.start_req((char *)"card.location.track"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req())
-			{
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_LOCATION_TRACK);
 	}
 
 	// Disable motion mode (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.motion.mode"))
 	{
-		if (rak_blues.start_req((char *)"card.motion.mode"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req())
-			{
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_MOTION_MODE);
 	}
 
 	// Disable motion sync (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.motion.sync"))
 	{
-		if (rak_blues.start_req((char *)"card.motion.sync"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req())
-			{
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_MOTION_SYNC);
 	}
 
 	// Disable motion tracking (just in case)
-	for (int try_send = 0; try_send < 3; try_send++)
+	if (rak_blues.start_req((char *)"card.motion.track"))
 	{
-		if (rak_blues.start_req((char *)"card.motion.track"))
-		{
-			rak_blues.add_bool_entry((char *)"stop", true);
-			if (rak_blues.send_req())
-			{
-				break;
-			}
-		}
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.config_add(CFG_MOTION_TRACK);
 	}
 
-	// Get card version
-	for (int try_send = 0; try_send < 3; try_send++)
+	// Send the changed settings in one pass
+	bool setup_success = rak_blues.config_apply(blues_setup_cb);
+	if (rak_blues.config_changed())
 	{
-		if (rak_blues.start_req((char *)"card.version"))
-		{
-			if (rak_blues.send_req())
-			{
-				break;
-			}
-		}
+		save_blues_config();
+	}
+	if (!setup_success)
+	{
+		return false;
+	}
+
+	// Sync at the latest 1 hour after the first note or when 10 notes are waiting
+	rak_blues.sync_begin(3600, 10);
+
+	// Sensor notes are stored in compact form, the CayenneLPP payload has max 64 bytes
+	rak_blues.template_add((char *)"data.qo", data_fields, 4, 64);
+
+	// Status queries change rarely, repeated queries are answered from RAM
+	rak_blues.cache_begin(g_blues_cache, 3);
+	rak_blues.cache_add((char *)"card.version", 0);
+	rak_blues.cache_add((char *)"hub.get", 0);
+	rak_blues.cache_add((char *)"hub.status", 10);
+
+	// Clock for the age of the location fix, GNSS is only switched on if the last fix is too old
+	rak_blues.time_begin();
+	blues_switch_gnss_mode(gnss_continuous);
+
+	// In continuous mode downlinks can arrive any time, wait for ATTN instead of polling
+	if (g_blues_settings.conn_continous)
+	{
+		blues_enable_attn();
 	}
 	return true;
 }
@@ -213,12 +230,11 @@ bool init_blues(void)
  */
 bool blues_send_payload(uint8_t *data, uint16_t data_len)
 {
-	char payload_b86[255];
-
-	if (rak_blues.start_req((char *)"note.add"))
+	// note.add is not idempotent, a retry after delivery would create a duplicate note
+	if (rak_blues.start_req((char *)"note.add", false))
 	{
+		// No "sync":true, the sync scheduler decides when to sync
 		rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
-		rak_blues.add_bool_entry((char *)"sync", true);
 		char node_id[24];
 		sprintf(node_id, "%02x%02x%02x%02x%02x%02x%02x%02x",
 				g_lorawan_settings.node_device_eui[0], g_lorawan_settings.node_device_eui[1],
@@ -232,9 +248,8 @@ bool blues_send_payload(uint8_t *data, uint16_t data_len)
 		rak_blues.add_nested_float_entry((char *)"body", (char *)"humid", bme680[1]);
 		rak_blues.add_nested_float_entry((char *)"body", (char *)"baro", bme680[2]);
 
-		rak_blues.myJB64Encode(payload_b86, (const char *)data, data_len);
-
-		rak_blues.add_string_entry((char *)"payload", payload_b86);
+		// Payload is Base64 encoded when the request is sent
+		rak_blues.add_payload_entry(data, data_len);
 
 		MYLOG("BLUES", "Finished parsing");
 		if (!rak_blues.send_req())
@@ -249,22 +264,115 @@ bool blues_send_payload(uint8_t *data, uint16_t data_len)
 }
 
 /**
- * @brief Request NoteHub status, only for debug purposes
+ * @brief Callback for received inbound notes
  *
+ * @param data decoded payload
+ * @param len length of payload
  */
-void blues_hub_status(void)
+void blues_rx_cb(uint8_t *data, size_t len)
 {
-	bool request_success = false;
-	for (int try_send = 0; try_send < 3; try_send++)
+	MYLOG("BLUES", "Received package over cellular, %d bytes", len);
+	char log_buff[len * 3 + 1] = {0};
+	uint16_t log_idx = 0;
+	for (size_t idx = 0; idx < len; idx++)
 	{
-		rak_blues.start_req((char *)"hub.status");
-		if (rak_blues.send_req())
-		{
-			request_success = true;
-			break;
-		}
+		sprintf(&log_buff[log_idx], "%02X ", data[idx]);
+		log_idx += 3;
 	}
-	if (!request_success)
+	MYLOG("BLUES", "%s", log_buff);
+}
+
+/**
+ * @brief Read pending downlinks from NoteHub (inbound notes in data.qi)
+ *
+ * @return uint16_t number of received notes
+ */
+uint16_t blues_get_inbound(void)
+{
+	return rak_blues.get_inbound_notes((char *)"data.qi", rcvd_data, sizeof(rcvd_data), blues_rx_cb);
+}
+
+/**
+ * @brief Add the location to the payload if the last fix is not older than 1 hour
+ * 		Answered from the location cache, GNSS is switched on only if the fix is too old
+ *
+ * @return true if a location was added
+ * @return false if no recent fix is known
+ */
+bool blues_get_location(void)
+{
+	blues_location location;
+	if (!rak_blues.location_get(&location))
+	{
+		MYLOG("BLUES", "No recent location, GNSS is searching");
+		return false;
+	}
+	MYLOG("BLUES", "Location %.6f %.6f, %ds old", location.lat, location.lon, location.age_s);
+	g_solution_data.addGNSS_4(LPP_CHANNEL_GPS, (int32_t)(location.lat * 10000000), (int32_t)(location.lon * 10000000), 0);
+	return true;
+}
+
+/**
+ * @brief Set the GNSS mode used by the location service while it waits for a fix
+ * 		GNSS left on by a reboot during a search is taken over by the location service
+ *
+ * @param continuous_on true for continuous mode, false to sample every 5 minutes
+ * @return true if the GNSS state was read from the NoteCard
+ * @return false if card.location.mode failed
+ */
+bool blues_switch_gnss_mode(bool continuous_on)
+{
+	gnss_continuous = continuous_on;
+	return rak_blues.location_begin(3600, continuous_on ? 0 : 300);
+}
+
+/**
+ * @brief Attach the ATTN interrupt and arm ATTN for new inbound notes
+ * 		Called again after each ATTN event to re-arm the NoteCard
+ *
+ * @return true if ATTN is armed
+ * @return false if card.attn failed
+ */
+bool blues_enable_attn(void)
+{
+	MYLOG("BLUES", "Enable ATTN");
+	if (!rak_blues.attn_begin(BLUES_ATTN_PIN, blues_attn_cb))
+	{
+		return false;
+	}
+	return rak_blues.attn_arm(BLUES_ATTN_FILES | BLUES_ATTN_LOCATION, (char *)"data.qi");
+}
+
+/**
+ * @brief Disarm ATTN and detach the interrupt
+ *
+ * @return true if ATTN is disarmed
+ * @return false if card.attn failed
+ */
+bool blues_disable_attn(void)
+{
+	MYLOG("BLUES", "Disable ATTN");
+	rak_blues.attn_end();
+	return rak_blues.attn_disarm();
+}
+
+/**
+ * @brief ATTN interrupt callback, wakes up the application
+ *
+ */
+void blues_attn_cb(void)
+{
+	api_wake_loop(BLUES_ATTN);
+}
+
+/**
+ * @brief Request NoteHub status, only for debug purposes
+ *
+ */
+void blues_hub_status(void)
+{
+	rak_blues.start_req((char *)"hub.status");
+	if (!rak_blues.send_req())
 	{
 		MYLOG("BLUES", "hub.status request failed");
 	}
@@ -280,4 +388,9 @@ void blues_card_restore(void)
 	rak_blues.add_bool_entry((char *)"delete", true);
 	rak_blues.add_bool_entry((char *)"connected", true);
 	rak_blues.send_req();
+	rak_blues.cache_invalidate();
+
+	// The settings on the NoteCard are unknown now
+	memset(&g_blues_config, 0, sizeof(blues_config_state));
+	save_blues_config();
 }
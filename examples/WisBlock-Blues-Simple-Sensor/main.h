@@ -73,11 +73,12 @@ void lora_data_handler(void);
 #define LPP_CHANNEL_TEMP_2 7	 // RAK1906
 #define LPP_CHANNEL_PRESS_2 8	 // RAK1906
 #define LPP_CHANNEL_GAS_2 9		 // RAK1906
-#define LPP_CHANNEL_GPS 10		 // RAK13102
+#define LPP_CHANNEL_GPS 10		 // RAK13102 / NoteCard GNSS
 #define LPP_CHANNEL_GPS_TOWER 11 // RAK13102
 
 // Globals
 extern WisCayenne g_solution_data;
+extern uint8_t rcvd_data[];
 
 // Blues.io
 struct s_blues_settings
@@ -92,6 +93,11 @@ struct s_blues_settings
 
 #include <blues-minimal-i2c.h>
 
+/** GPIO connected to the NoteCard ATTN pin */
+#ifndef BLUES_ATTN_PIN
+#define BLUES_ATTN_PIN WB_IO5
+#endif
+
 bool init_blues(void);
 // bool start_req(char *request);
 // bool send_req(void);
@@ -100,14 +106,18 @@ bool blues_get_location(void);
 bool blues_enable_attn(void);
 bool blues_disable_attn(void);
 bool blues_send_payload(uint8_t *data, uint16_t data_len);
+uint16_t blues_get_inbound(void);
 bool blues_switch_gnss_mode(bool continuous_on);
 void blues_card_restore(void);
 void blues_attn_cb(void);
 extern RAK_BLUES rak_blues;
 extern s_blues_settings g_blues_settings;
+extern blues_config_state g_blues_config;
 
 // User AT commands
 void init_user_at(void);
 bool read_blues_settings(void);
 void save_blues_settings(void);
+bool read_blues_config(void);
+void save_blues_config(void);
 #endif // _MAIN_H_
\ No newline at end of file
@@ -16,6 +16,8 @@ using namespace Adafruit_LittleFS_Namespace;
 
 /** Filename to save Blues settings */
 static const char blues_file_name[] = "BLUES";
+/** Filename to save the last applied NoteCard settings */
+static const char blues_cfg_file_name[] = "BLUES_CFG";
 
 /** File to save battery check status */
 File this_file(InternalFS);
@@ -248,13 +250,13 @@ int at_set_blues_mode(char *str)
 	{
 		MYLOG("USR_AT", "Set minimum connection mode");
 		new_connection_mode = false;
-		// blues_disable_attn();
+		blues_disable_attn();
 	}
 	else if (str[0] == '1')
 	{
 		MYLOG("USR_AT", "Set continuous connection mode");
 		new_connection_mode = true;
-		// blues_enable_attn();
+		blues_enable_attn();
 	}
 	else
 	{
@@ -471,6 +473,43 @@ void save_blues_settings(void)
 	MYLOG("USR_AT", "Saved Blues Settings");
 }
 
+/**
+ * @brief Read the last applied NoteCard settings from flash
+ * 		If no file is found, the settings are unknown and will be sent to the NoteCard
+ *
+ * @return true if the file was found
+ * @return false if no file was found
+ */
+bool read_blues_config(void)
+{
+	memset(&g_blues_config, 0, sizeof(blues_config_state));
+	if (InternalFS.exists(blues_cfg_file_name))
+	{
+		this_file.open(blues_cfg_file_name, FILE_O_READ);
+		this_file.read((void *)&g_blues_config, sizeof(blues_config_state));
+		this_file.close();
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Save the last applied NoteCard settings to flash
+ *
+ */
+void save_blues_config(void)
+{
+	if (InternalFS.exists(blues_cfg_file_name))
+	{
+		InternalFS.remove(blues_cfg_file_name);
+	}
+
+	this_file.open(blues_cfg_file_name, FILE_O_WRITE);
+	this_file.write((const char *)&g_blues_config, sizeof(blues_config_state));
+	this_file.close();
+	MYLOG("USR_AT", "Saved Blues config state");
+}
+
 int at_blues_req(char *str)
 {
 	for (int i = 0; str[i] != '\0'; i++)
@@ -0,0 +1,217 @@
+/**
+ * @file base64_test.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test and benchmark of the Base64 module
+ * 		Checks the RFC 4648 test vectors, encode/decode round trips and the incremental encoder,
+ * 		then compares the speed with the former myJB64Encode().
+ * 		Build and run on the host:
+ * 		g++ -O2 -I src extras/test/base64_test.cpp src/blues-base64.cpp -o base64_test && ./base64_test
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "blues-base64.h"
+
+/** Alphabet of the former encoder */
+static const char basis_64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @brief Former encoder of RAK_BLUES, reference for the results and the speed
+ *
+ * @param encoded (out) encoded string
+ * @param string bytes to encode
+ * @param len number of bytes
+ * @return int length of the encoded string including the 0 terminator
+ */
+static int myJB64Encode(char *encoded, const char *string, int len)
+{
+	int i;
+	char *p;
+
+	p = encoded;
+	for (i = 0; i < len - 2; i += 3)
+	{
+		*p++ = basis_64[(string[i] >> 2) & 0x3F];
+		*p++ = basis_64[((string[i] & 0x3) << 4) | ((int)(string[i + 1] & 0xF0) >> 4)];
+		*p++ = basis_64[((string[i + 1] & 0xF) << 2) | ((int)(string[i + 2] & 0xC0) >> 6)];
+		*p++ = basis_64[string[i + 2] & 0x3F];
+	}
+	if (i < len)
+	{
+		*p++ = basis_64[(string[i] >> 2) & 0x3F];
+		if (i == (len - 1))
+		{
+			*p++ = basis_64[((string[i] & 0x3) << 4)];
+			*p++ = '=';
+		}
+		else
+		{
+			*p++ = basis_64[((string[i] & 0x3) << 4) | ((int)(string[i + 1] & 0xF0) >> 4)];
+			*p++ = basis_64[((string[i + 1] & 0xF) << 2)];
+		}
+		*p++ = '=';
+	}
+
+	*p++ = '\0';
+	return p - encoded;
+}
+
+/** Number of failed checks */
+static int failed = 0;
+
+/**
+ * @brief Count and report a failed check
+ *
+ * @param ok result of the check
+ * @param what description of the check
+ */
+static void check(bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("FAIL: %s\n", what);
+		failed++;
+	}
+}
+
+/**
+ * @brief RFC 4648 section 10 test vectors, encoding and decoding
+ *
+ */
+static void test_rfc4648(void)
+{
+	static const char *vectors[][2] = {
+		{"", ""},
+		{"f", "Zg=="},
+		{"fo", "Zm8="},
+		{"foo", "Zm9v"},
+		{"foob", "Zm9vYg=="},
+		{"fooba", "Zm9vYmE="},
+		{"foobar", "Zm9vYmFy"}};
+
+	for (size_t idx = 0; idx < sizeof(vectors) / sizeof(vectors[0]); idx++)
+	{
+		const char *plain = vectors[idx][0];
+		const char *expect = vectors[idx][1];
+		char encoded[16];
+		uint8_t decoded[16];
+		size_t dec_len = 0;
+
+		size_t enc_len = blues_b64_encode(encoded, (const uint8_t *)plain, strlen(plain));
+		check((enc_len == strlen(expect)) && (strcmp(encoded, expect) == 0), expect);
+		check(blues_b64_encoded_len(strlen(plain)) == enc_len, "encoded length");
+		check(blues_b64_decode(decoded, sizeof(decoded), expect, strlen(expect), &dec_len), expect);
+		check((dec_len == strlen(plain)) && (memcmp(decoded, plain, dec_len) == 0), plain);
+	}
+
+	uint8_t decoded[16];
+	size_t dec_len = 0;
+	check(!blues_b64_decode(decoded, sizeof(decoded), "Zm9v!", 5, &dec_len), "invalid character");
+	check(!blues_b64_decode(decoded, sizeof(decoded), "Zm9vY", 5, &dec_len), "single character left");
+	check(!blues_b64_decode(decoded, 2, "Zm9v", 4, &dec_len), "buffer too small");
+	check(blues_b64_decode(decoded, sizeof(decoded), "Zm8", 3, &dec_len) && (dec_len == 2), "missing padding");
+}
+
+/**
+ * @brief Round trips of random data against the former encoder, one shot, incremental and in place
+ *
+ */
+static void test_round_trip(void)
+{
+	static uint8_t data[1024];
+	static char encoded[BLUES_B64_ENC_SIZE(sizeof(data))];
+	static char reference[BLUES_B64_ENC_SIZE(sizeof(data))];
+	static uint8_t decoded[sizeof(data)];
+
+	srand(1);
+	for (size_t len = 0; len <= sizeof(data); len++)
+	{
+		for (size_t idx = 0; idx < len; idx++)
+		{
+			data[idx] = (uint8_t)rand();
+		}
+
+		size_t enc_len = blues_b64_encode(encoded, data, len);
+		myJB64Encode(reference, (const char *)data, (int)len);
+		check(strcmp(encoded, reference) == 0, "same result as myJB64Encode");
+
+		size_t dec_len = 0;
+		check(blues_b64_decode(decoded, sizeof(decoded), encoded, enc_len, &dec_len), "decode");
+		check((dec_len == len) && (memcmp(decoded, data, len) == 0), "round trip");
+
+		// Incremental encoder with pieces of 1 to 7 bytes
+		blues_b64_enc enc;
+		blues_b64_enc_init(&enc);
+		size_t inc_len = 0;
+		size_t pos = 0;
+		size_t piece = 1;
+		while (pos < len)
+		{
+			size_t now = ((len - pos) < piece) ? (len - pos) : piece;
+			inc_len += blues_b64_enc_update(&enc, &encoded[inc_len], &data[pos], now);
+			pos += now;
+			piece = (piece % 7) + 1;
+		}
+		inc_len += blues_b64_enc_final(&enc, &encoded[inc_len]);
+		encoded[inc_len] = 0;
+		check((inc_len == enc_len) && (strcmp(encoded, reference) == 0), "incremental encoder");
+
+		// Decode in place
+		check(blues_b64_decode((uint8_t *)encoded, sizeof(encoded), encoded, inc_len, &dec_len), "decode in place");
+		check((dec_len == len) && (memcmp(encoded, data, len) == 0), "round trip in place");
+	}
+}
+
+/**
+ * @brief Compare the speed of blues_b64_encode() and myJB64Encode()
+ * 		The payload size is the largest payload that fits into a NoteCard request.
+ *
+ */
+static void benchmark(void)
+{
+	static uint8_t data[1536];
+	static char encoded[BLUES_B64_ENC_SIZE(sizeof(data))];
+	const int rounds = 200000;
+	volatile size_t sink = 0;
+
+	for (size_t idx = 0; idx < sizeof(data); idx++)
+	{
+		data[idx] = (uint8_t)(idx * 7);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (int round = 0; round < rounds; round++)
+	{
+		data[0] = (uint8_t)round;
+		sink += myJB64Encode(encoded, (const char *)data, sizeof(data));
+	}
+	double old_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int round = 0; round < rounds; round++)
+	{
+		data[0] = (uint8_t)round;
+		sink += blues_b64_encode(encoded, data, sizeof(data));
+	}
+	double new_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double mbytes = (double)sizeof(data) * rounds / 1e6;
+	printf("myJB64Encode:     %7.1f MB/s\n", mbytes / old_s);
+	printf("blues_b64_encode: %7.1f MB/s (%.2fx)\n", mbytes / new_s, old_s / new_s);
+	(void)sink;
+}
+
+int main(void)
+{
+	test_rfc4648();
+	test_round_trip();
+	benchmark();
+	printf("%s, %d failed checks\n", (failed == 0) ? "PASSED" : "FAILED", failed);
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file Arduino.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Minimal Arduino API for the host tests of the library
+ * 		millis() runs on a simulated clock, delay() only advances it.
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef _ARDUINO_MOCK_H_
+#define _ARDUINO_MOCK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define OUTPUT_OPEN_DRAIN 4
+#define HIGH 1
+#define LOW 0
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define digitalPinToInterrupt(p) (p)
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long random(long max);
+long random(long min, long max);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint32_t irq, void (*isr)(void), int mode);
+void detachInterrupt(uint32_t irq);
+
+/**
+ * @brief Serial port, printf() goes to stdout
+ *
+ */
+class HardwareSerial
+{
+public:
+	int printf(const char *format, ...);
+	void flush(void) {}
+	void println(const char *text) { puts(text); }
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file Wire.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief I2C bus for the host tests, connected to a simulated NoteCard
+ * 		Requests written by the library are passed to notecard_mock_request(),
+ * 		the responses it queues are read back with the NoteCard serial-over-I2C protocol.
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef _WIRE_MOCK_H_
+#define _WIRE_MOCK_H_
+
+#include <Arduino.h>
+
+/** Set by the test, called with each complete request line without the newline */
+extern void (*notecard_mock_request)(const char *request);
+/** Queue a response, the newline is added */
+void notecard_mock_respond(const char *response);
+/** Number of response bytes not yet read by the library */
+size_t notecard_mock_pending(void);
+
+/**
+ * @brief I2C bus with the simulated NoteCard as the only device
+ *
+ */
+class TwoWire
+{
+public:
+	void begin(void) {}
+	void end(void) {}
+	void setClock(uint32_t clock) {}
+	void beginTransmission(uint8_t address);
+	size_t write(uint8_t data);
+	size_t write(const uint8_t *data, size_t len);
+	uint8_t endTransmission(bool stop = true);
+	uint8_t requestFrom(int address, int len);
+	int read(void);
+	int available(void);
+
+private:
+	uint8_t _tx[256];
+	size_t _tx_len = 0;
+	uint8_t _rx[256];
+	size_t _rx_len = 0;
+	size_t _rx_pos = 0;
+	uint8_t _read_count = 0;
+};
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,163 @@
+/**
+ * @file arduino_mock.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Simulated clock, GPIO and NoteCard for the host tests of the library
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <string>
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+/** Simulated time in microseconds */
+static unsigned long long mock_us = 0;
+
+/** Request line received by the NoteCard */
+static std::string mock_request;
+/** Responses waiting to be read by the library */
+static std::string mock_response;
+
+void (*notecard_mock_request)(const char *request) = NULL;
+
+unsigned long millis(void)
+{
+	return (unsigned long)(mock_us / 1000);
+}
+
+unsigned long micros(void)
+{
+	return (unsigned long)mock_us;
+}
+
+void delay(unsigned long ms)
+{
+	mock_us += (unsigned long long)ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	mock_us += us;
+}
+
+long random(long max)
+{
+	return (max > 0) ? (rand() % max) : 0;
+}
+
+long random(long min, long max)
+{
+	return min + random(max - min);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+void attachInterrupt(uint32_t irq, void (*isr)(void), int mode) {}
+void detachInterrupt(uint32_t irq) {}
+
+int HardwareSerial::printf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int len = vprintf(format, args);
+	va_end(args);
+	return len;
+}
+
+void notecard_mock_respond(const char *response)
+{
+	mock_response += response;
+	mock_response += '\n';
+}
+
+size_t notecard_mock_pending(void)
+{
+	return mock_response.size();
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+	_tx_len = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+	if (_tx_len < sizeof(_tx))
+	{
+		_tx[_tx_len++] = data;
+	}
+	return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len)
+{
+	for (size_t idx = 0; idx < len; idx++)
+	{
+		write(data[idx]);
+	}
+	return len;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+	if (_tx_len == 0)
+	{
+		// Address probe
+		return 0;
+	}
+	if (_tx[0] == 0)
+	{
+		// Read request, the second byte is the number of bytes to read
+		_read_count = (_tx_len > 1) ? _tx[1] : 0;
+		return 0;
+	}
+	// Data, the first byte is the length
+	for (size_t idx = 1; (idx < _tx_len) && (idx <= _tx[0]); idx++)
+	{
+		if (_tx[idx] != '\n')
+		{
+			mock_request += (char)_tx[idx];
+			continue;
+		}
+		if (!mock_request.empty() && (notecard_mock_request != NULL))
+		{
+			notecard_mock_request(mock_request.c_str());
+		}
+		mock_request.clear();
+	}
+	return 0;
+}
+
+uint8_t TwoWire::requestFrom(int address, int len)
+{
+	// Answer: bytes still available after this read, byte count, data
+	size_t count = _read_count;
+	if (count > mock_response.size())
+	{
+		count = mock_response.size();
+	}
+	size_t left = mock_response.size() - count;
+	_rx[0] = (uint8_t)((left > 253) ? 253 : left);
+	_rx[1] = (uint8_t)count;
+	memcpy(&_rx[2], mock_response.data(), count);
+	mock_response.erase(0, count);
+	_rx_len = count + 2;
+	_rx_pos = 0;
+	return (uint8_t)_rx_len;
+}
+
+int TwoWire::read(void)
+{
+	return (_rx_pos < _rx_len) ? _rx[_rx_pos++] : -1;
+}
+
+int TwoWire::available(void)
+{
+	return (int)(_rx_len - _rx_pos);
+}
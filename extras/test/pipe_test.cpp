@@ -0,0 +1,208 @@
+/**
+ * @file pipe_test.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Host test of the request pipeline against a simulated NoteCard
+ * 		Runs pipelines until they are empty, with responses that arrive together, later or never.
+ * 		Build and run on the host with ArduinoJson 6:
+ * 		g++ -I extras/test/mock -I <ArduinoJson>/src -I src extras/test/pipe_test.cpp extras/test/mock/arduino_mock.cpp src/blues-minimal-i2c.cpp src/blues-base64.cpp src/blues-cobs.cpp src/blues-md5.cpp -o pipe_test && ./pipe_test
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include <string>
+#include <vector>
+#include "blues-minimal-i2c.h"
+
+RAK_BLUES rak_blues;
+
+/** Number of failed checks */
+static int failed = 0;
+
+/** Responses held back by the simulated NoteCard */
+static std::vector<std::string> held;
+/** Respond immediately, otherwise the responses are held back */
+static bool respond_now = true;
+/** Ids reported by pipe_poll() */
+static std::vector<uint32_t> done_ids;
+/** Number of requests reported as failed */
+static int done_failed = 0;
+
+/**
+ * @brief Count and report a failed check
+ *
+ * @param ok result of the check
+ * @param what description of the check
+ */
+static void check(bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("FAIL: %s\n", what);
+		failed++;
+	}
+}
+
+/**
+ * @brief Simulated NoteCard, answers each request with its id
+ *
+ * @param request request line
+ */
+static void notecard(const char *request)
+{
+	const char *id = strstr(request, "\"id\":");
+	char response[64];
+	snprintf(response, sizeof(response), "{\"id\":%lu}", (id != NULL) ? strtoul(id + 5, NULL, 10) : 0UL);
+	if (respond_now)
+	{
+		notecard_mock_respond(response);
+	}
+	else
+	{
+		held.push_back(response);
+	}
+}
+
+/**
+ * @brief Release the held back responses
+ *
+ */
+static void release(void)
+{
+	for (size_t idx = 0; idx < held.size(); idx++)
+	{
+		notecard_mock_respond(held[idx].c_str());
+	}
+	held.clear();
+}
+
+/**
+ * @brief Callback of pipe_poll()
+ *
+ * @param id id of the finished request
+ * @param success true if the request succeeded
+ */
+static void pipe_cb(uint32_t id, bool success)
+{
+	done_ids.push_back(id);
+	if (!success)
+	{
+		done_failed++;
+	}
+}
+
+/**
+ * @brief Send a note.add into the pipeline
+ *
+ * @param count value of the note
+ * @return uint32_t id of the request, 0 if it was not sent
+ */
+static uint32_t send_note(int32_t count)
+{
+	uint32_t id = 0;
+	rak_blues.start_req((char *)"note.add", false);
+	rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
+	rak_blues.add_int32_entry((char *)"count", count);
+	if (!rak_blues.pipe_send(&id))
+	{
+		return 0;
+	}
+	return id;
+}
+
+/**
+ * @brief All responses arrive together, the last one empties the pipeline
+ *
+ */
+static void test_flush(void)
+{
+	respond_now = true;
+	done_ids.clear();
+	done_failed = 0;
+
+	uint16_t notes = rak_blues.sync_pending();
+	uint32_t ids[3];
+	for (int idx = 0; idx < 3; idx++)
+	{
+		ids[idx] = send_note(idx);
+		check(ids[idx] != 0, "pipe_send");
+	}
+	check(rak_blues.pipe_pending() == 3, "3 requests in flight");
+	check(rak_blues.sync_pending() == (notes + 3), "pipelined notes counted for the sync scheduler");
+	check(rak_blues.pipe_flush(pipe_cb) == 3, "flush finishes 3 requests");
+	check(rak_blues.pipe_pending() == 0, "pipeline empty after flush");
+	check(done_failed == 0, "no failed requests");
+	check((done_ids.size() == 3) && (done_ids[0] == ids[0]) && (done_ids[1] == ids[1]) && (done_ids[2] == ids[2]), "ids in order");
+	check(notecard_mock_pending() == 0, "all responses read");
+}
+
+/**
+ * @brief Responses arrive after the requests, the pipeline is polled until it is empty
+ *
+ */
+static void test_poll(void)
+{
+	respond_now = false;
+	done_ids.clear();
+	done_failed = 0;
+
+	uint32_t first = send_note(10);
+	uint32_t second = send_note(11);
+	check((first != 0) && (second != 0), "pipe_send");
+	check(rak_blues.pipe_poll(pipe_cb) == 0, "nothing finished before the responses");
+	check(rak_blues.pipe_pending() == 2, "2 requests in flight");
+
+	release();
+	uint8_t finished = 0;
+	for (int loop = 0; (loop < 10) && (rak_blues.pipe_pending() != 0); loop++)
+	{
+		finished += rak_blues.pipe_poll(pipe_cb);
+	}
+	check(finished == 2, "poll finishes 2 requests");
+	check(rak_blues.pipe_pending() == 0, "pipeline empty after poll");
+	check((done_ids.size() == 2) && (done_ids[0] == first) && (done_ids[1] == second), "ids in order");
+	check(done_failed == 0, "no failed requests");
+}
+
+/**
+ * @brief A request without response is reported as failed after 30 seconds
+ *
+ */
+static void test_lost(void)
+{
+	respond_now = false;
+	done_ids.clear();
+	done_failed = 0;
+
+	uint32_t id = send_note(20);
+	check(id != 0, "pipe_send");
+	check(rak_blues.pipe_flush(pipe_cb) == 1, "flush reports the lost request");
+	check((done_ids.size() == 1) && (done_ids[0] == id) && (done_failed == 1), "lost request failed");
+	check(rak_blues.pipe_pending() == 0, "pipeline empty after timeout");
+
+	// The late response must not be taken for the next request
+	release();
+	respond_now = true;
+	done_ids.clear();
+	done_failed = 0;
+	id = send_note(21);
+	check(rak_blues.pipe_flush(pipe_cb) == 1, "next request after the timeout");
+	check((done_ids.size() == 1) && (done_ids[0] == id) && (done_failed == 0), "next request succeeded");
+	check(rak_blues.pipe_pending() == 0, "pipeline empty");
+}
+
+int main(void)
+{
+	notecard_mock_request = notecard;
+	test_flush();
+	// Again, the receive buffer must be consistent after the pipeline was empty
+	test_flush();
+	test_poll();
+	test_lost();
+	test_flush();
+	printf("%s, %d failed checks\n", (failed == 0) ? "PASSED" : "FAILED", failed);
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,351 @@
+/**
+ * @file blues-base64.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Base64 encoding for NoteCard payloads
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <string.h>
+#include "blues-base64.h"
+
+/** Base64 alphabet, constant and shared by all instances, stays in flash */
+static constexpr char b64_table[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @brief Encode one group of 3 bytes into 4 characters
+ * 		The 3 bytes are combined into one 24 bit word, the 4 characters are stored
+ * 		with a single 32 bit write on little endian MCU's.
+ *
+ * @param encoded (out) 4 characters, no 0 terminator
+ * @param data 3 bytes to encode
+ */
+static inline void b64_encode_group(char *encoded, const uint8_t *data)
+{
+	uint32_t word = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | (uint32_t)data[2];
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	uint32_t chars = (uint32_t)(uint8_t)b64_table[word >> 18] |
+					 ((uint32_t)(uint8_t)b64_table[(word >> 12) & 0x3F] << 8) |
+					 ((uint32_t)(uint8_t)b64_table[(word >> 6) & 0x3F] << 16) |
+					 ((uint32_t)(uint8_t)b64_table[word & 0x3F] << 24);
+	memcpy(encoded, &chars, 4);
+#else
+	encoded[0] = b64_table[word >> 18];
+	encoded[1] = b64_table[(word >> 12) & 0x3F];
+	encoded[2] = b64_table[(word >> 6) & 0x3F];
+	encoded[3] = b64_table[word & 0x3F];
+#endif
+}
+
+/**
+ * @brief Encode the last 1 or 2 bytes with padding
+ *
+ * @param encoded (out) 4 characters, no 0 terminator
+ * @param data bytes to encode
+ * @param len 1 or 2
+ */
+static inline void b64_encode_tail(char *encoded, const uint8_t *data, size_t len)
+{
+	uint32_t word = (uint32_t)data[0] << 16;
+	if (len == 2)
+	{
+		word |= (uint32_t)data[1] << 8;
+	}
+	encoded[0] = b64_table[word >> 18];
+	encoded[1] = b64_table[(word >> 12) & 0x3F];
+	encoded[2] = (len == 2) ? b64_table[(word >> 6) & 0x3F] : '=';
+	encoded[3] = '=';
+}
+
+/**
+ * @brief Get the length of the Base64 encoded data
+ *
+ * @param len number of bytes to encode
+ * @return size_t number of characters, without 0 terminator
+ */
+size_t blues_b64_encoded_len(size_t len)
+{
+	return ((len + 2) / 3) * 4;
+}
+
+/**
+ * @brief Encode a byte buffer to Base64
+ *
+ * @param encoded (out) encoded string, needs BLUES_B64_ENC_SIZE(len) bytes
+ * @param data bytes to encode
+ * @param len number of bytes to encode
+ * @return size_t length of the encoded string, without 0 terminator
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+
+	uint8_t data[] = {0x00, 0x01, 0x02, 0xff};
+	char encoded[BLUES_B64_ENC_SIZE(sizeof(data))];
+
+	void setup()
+	{
+		blues_b64_encode(encoded, data, sizeof(data));
+	}
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+size_t blues_b64_encode(char *encoded, const uint8_t *data, size_t len)
+{
+	char *out = encoded;
+	while (len >= 3)
+	{
+		b64_encode_group(out, data);
+		out += 4;
+		data += 3;
+		len -= 3;
+	}
+	if (len != 0)
+	{
+		b64_encode_tail(out, data, len);
+		out += 4;
+	}
+	*out = 0;
+	return out - encoded;
+}
+
+/**
+ * @brief Start an incremental Base64 encoding
+ *
+ * @param enc encoder state
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+
+	blues_b64_enc enc;
+	char encoded[64];
+
+	void setup()
+	{
+		size_t enc_len = 0;
+		blues_b64_enc_init(&enc);
+		// Data can arrive in pieces of any size
+		enc_len += blues_b64_enc_update(&enc, &encoded[enc_len], (const uint8_t *)"Hel", 3);
+		enc_len += blues_b64_enc_update(&enc, &encoded[enc_len], (const uint8_t *)"lo", 2);
+		enc_len += blues_b64_enc_final(&enc, &encoded[enc_len]);
+		encoded[enc_len] = 0;
+	}
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+void blues_b64_enc_init(blues_b64_enc *enc)
+{
+	enc->rest_len = 0;
+}
+
+/**
+ * @brief Encode the next piece of data
+ * 		Only complete 3 byte groups are written, up to 2 bytes are kept in the encoder state.
+ * 		The output is not 0 terminated.
+ *
+ * @param enc encoder state
+ * @param encoded (out) encoded characters, needs ((rest + len) / 3) * 4 bytes
+ * @param data bytes to encode
+ * @param len number of bytes to encode
+ * @return size_t number of characters written
+ */
+size_t blues_b64_enc_update(blues_b64_enc *enc, char *encoded, const uint8_t *data, size_t len)
+{
+	char *out = encoded;
+
+	// Complete a group with the bytes left from the last call
+	if (enc->rest_len != 0)
+	{
+		size_t need = 3 - enc->rest_len;
+		if (len < need)
+		{
+			// Still no complete group
+			for (size_t idx = 0; idx < len; idx++)
+			{
+				enc->rest[enc->rest_len++] = data[idx];
+			}
+			return 0;
+		}
+		uint8_t group[3];
+		group[0] = enc->rest[0];
+		group[1] = (enc->rest_len == 2) ? enc->rest[1] : data[0];
+		group[2] = data[need - 1];
+		b64_encode_group(out, group);
+		out += 4;
+		data += need;
+		len -= need;
+		enc->rest_len = 0;
+	}
+
+	while (len >= 3)
+	{
+		b64_encode_group(out, data);
+		out += 4;
+		data += 3;
+		len -= 3;
+	}
+
+	// Keep the remaining bytes for the next call
+	for (size_t idx = 0; idx < len; idx++)
+	{
+		enc->rest[idx] = data[idx];
+	}
+	enc->rest_len = len;
+	return out - encoded;
+}
+
+/**
+ * @brief Finish an incremental Base64 encoding and add the padding
+ * 		The output is not 0 terminated.
+ *
+ * @param enc encoder state
+ * @param encoded (out) encoded characters, needs 4 bytes
+ * @return size_t number of characters written, 0 or 4
+ */
+size_t blues_b64_enc_final(blues_b64_enc *enc, char *encoded)
+{
+	if (enc->rest_len == 0)
+	{
+		return 0;
+	}
+	b64_encode_tail(encoded, enc->rest, enc->rest_len);
+	enc->rest_len = 0;
+	return 4;
+}
+
+/**
+ * @brief Get the 6 bit value of a Base64 character
+ *
+ * @param c Base64 character
+ * @return int8_t value 0 to 63, -1 if c is not a Base64 character
+ */
+static inline int8_t b64_value(char c)
+{
+	if ((c >= 'A') && (c <= 'Z'))
+	{
+		return c - 'A';
+	}
+	if ((c >= 'a') && (c <= 'z'))
+	{
+		return c - 'a' + 26;
+	}
+	if ((c >= '0') && (c <= '9'))
+	{
+		return c - '0' + 52;
+	}
+	if (c == '+')
+	{
+		return 62;
+	}
+	if (c == '/')
+	{
+		return 63;
+	}
+	return -1;
+}
+
+/**
+ * @brief Decode a Base64 string
+ * 		Decoding in place is possible, decoded can point to the same memory as encoded,
+ * 		because the decoded data is always shorter than the encoded string.
+ * 		Missing padding at the end is accepted.
+ *
+ * @param decoded (out) buffer for the decoded data, needs BLUES_B64_DEC_SIZE(len) bytes or less
+ * @param size size of the buffer for the decoded data
+ * @param encoded Base64 string
+ * @param len length of the Base64 string
+ * @param decoded_len (out) number of decoded bytes
+ * @return true if the string was decoded
+ * @return false if the string has invalid characters or the buffer is too small
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+
+	char encoded[] = "AWcBEA==";
+	uint8_t decoded[BLUES_B64_DEC_SIZE(sizeof(encoded) - 1)];
+	size_t decoded_len;
+
+	void setup()
+	{
+		if (blues_b64_decode(decoded, sizeof(decoded), encoded, strlen(encoded), &decoded_len))
+		{
+			// decoded has 0x01 0x67 0x01 0x10, decoded_len is 4
+		}
+		// Decode in place
+		blues_b64_decode((uint8_t *)encoded, sizeof(encoded), encoded, strlen(encoded), &decoded_len);
+	}
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool blues_b64_decode(uint8_t *decoded, size_t size, const char *encoded, size_t len, size_t *decoded_len)
+{
+	size_t out = 0;
+	uint32_t word = 0;
+	uint8_t chars = 0;
+
+	*decoded_len = 0;
+
+	// Ignore the padding
+	while ((len != 0) && (encoded[len - 1] == '='))
+	{
+		len--;
+	}
+
+	for (size_t idx = 0; idx < len; idx++)
+	{
+		int8_t value = b64_value(encoded[idx]);
+		if (value < 0)
+		{
+			return false;
+		}
+		word = (word << 6) | (uint32_t)value;
+		chars++;
+		if (chars == 4)
+		{
+			if ((out + 3) > size)
+			{
+				return false;
+			}
+			decoded[out++] = (uint8_t)(word >> 16);
+			decoded[out++] = (uint8_t)(word >> 8);
+			decoded[out++] = (uint8_t)word;
+			word = 0;
+			chars = 0;
+		}
+	}
+
+	// 2 or 3 characters left give 1 or 2 bytes, a single character is invalid
+	if (chars == 1)
+	{
+		return false;
+	}
+	if (chars != 0)
+	{
+		if ((out + chars - 1) > size)
+		{
+			return false;
+		}
+		word <<= 6 * (4 - chars);
+		decoded[out++] = (uint8_t)(word >> 16);
+		if (chars == 3)
+		{
+			decoded[out++] = (uint8_t)(word >> 8);
+		}
+	}
+
+	*decoded_len = out;
+	return true;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file blues-base64.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief Base64 encoding for NoteCard payloads
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef _BLUES_BASE64_H_
+#define _BLUES_BASE64_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Buffer size needed to Base64 encode n bytes, including the 0 terminator */
+#define BLUES_B64_ENC_SIZE(n) ((((n) + 2) / 3) * 4 + 1)
+
+/** Max number of bytes decoded from n Base64 characters */
+#define BLUES_B64_DEC_SIZE(n) ((((n) + 3) / 4) * 3)
+
+/**
+ * @brief State of an incremental Base64 encoder
+ *
+ */
+struct blues_b64_enc
+{
+	uint8_t rest[2];  ///< Bytes waiting for a complete 3 byte group
+	uint8_t rest_len; ///< Number of bytes in rest
+};
+
+size_t blues_b64_encoded_len(size_t len);
+size_t blues_b64_encode(char *encoded, const uint8_t *data, size_t len);
+
+void blues_b64_enc_init(blues_b64_enc *enc);
+size_t blues_b64_enc_update(blues_b64_enc *enc, char *encoded, const uint8_t *data, size_t len);
+size_t blues_b64_enc_final(blues_b64_enc *enc, char *encoded);
+
+bool blues_b64_decode(uint8_t *decoded, size_t size, const char *encoded, size_t len, size_t *decoded_len);
+
+#endif // _BLUES_BASE64_H_
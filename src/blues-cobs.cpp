@@ -0,0 +1,141 @@
+/**
+ * @file blues-cobs.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief COBS framing for the NoteCard binary buffer
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include "blues-cobs.h"
+
+/**
+ * @brief Get the exact length of the COBS encoded data
+ * 		Needed before encoding, e.g. for the "cobs" entry of card.binary.put.
+ *
+ * @param data bytes to encode
+ * @param len number of bytes to encode
+ * @return size_t length of the encoded data
+ */
+size_t blues_cobs_encoded_len(const uint8_t *data, size_t len)
+{
+	size_t enc_len = 1;
+	uint8_t code = 1;
+	while (len-- != 0)
+	{
+		if (*data++ != 0)
+		{
+			enc_len++;
+			code++;
+			if (code == 0xFF)
+			{
+				enc_len++;
+				code = 1;
+			}
+		}
+		else
+		{
+			enc_len++;
+			code = 1;
+		}
+	}
+	return enc_len;
+}
+
+/**
+ * @brief COBS encode a byte buffer
+ * 		COBS removes all 0 bytes from the data. Each encoded byte is XOR'ed with eop,
+ * 		the NoteCard uses '\n' as eop, then the encoded data has no newline and the newline
+ * 		marks the end of the binary data.
+ *
+ * @param encoded (out) encoded data, needs BLUES_COBS_ENC_SIZE(len) bytes
+ * @param data bytes to encode
+ * @param len number of bytes to encode
+ * @param eop end of packet character that must not appear in the encoded data
+ * @return size_t length of the encoded data
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+
+	uint8_t data[] = {0x00, 0x0a, 0x02, 0x00};
+	uint8_t encoded[BLUES_COBS_ENC_SIZE(sizeof(data))];
+
+	void setup()
+	{
+		size_t enc_len = blues_cobs_encode(encoded, data, sizeof(data), '\n');
+	}
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+size_t blues_cobs_encode(uint8_t *encoded, const uint8_t *data, size_t len, uint8_t eop)
+{
+	uint8_t *out = encoded;
+	uint8_t *code_ptr = out++;
+	uint8_t code = 1;
+
+	while (len-- != 0)
+	{
+		uint8_t value = *data++;
+		if (value != 0)
+		{
+			*out++ = value ^ eop;
+			code++;
+		}
+		// A 0 byte or a full block of 254 bytes ends the block
+		if ((value == 0) || (code == 0xFF))
+		{
+			*code_ptr = code ^ eop;
+			code = 1;
+			code_ptr = out++;
+		}
+	}
+	*code_ptr = code ^ eop;
+	return out - encoded;
+}
+
+/**
+ * @brief Decode COBS encoded data
+ * 		Decoding in place is possible, decoded can point to the same memory as encoded,
+ * 		because the decoded data is always shorter than the encoded data.
+ *
+ * @param decoded (out) decoded data, needs len bytes or less
+ * @param encoded encoded data, without the eop character at the end
+ * @param len length of the encoded data
+ * @param eop end of packet character used for encoding
+ * @return size_t length of the decoded data
+ */
+size_t blues_cobs_decode(uint8_t *decoded, const uint8_t *encoded, size_t len, uint8_t eop)
+{
+	const uint8_t *end = encoded + len;
+	uint8_t *out = decoded;
+	uint8_t code = 0xFF;
+	uint8_t copy = 0;
+
+	while (encoded < end)
+	{
+		if (copy != 0)
+		{
+			*out++ = *encoded++ ^ eop;
+		}
+		else
+		{
+			// Each block but a full one ends with a 0 byte
+			if (code != 0xFF)
+			{
+				*out++ = 0;
+			}
+			copy = code = *encoded++ ^ eop;
+			if (code == 0)
+			{
+				break;
+			}
+		}
+		copy--;
+	}
+	return out - decoded;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file blues-cobs.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief COBS framing for the NoteCard binary buffer
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef _BLUES_COBS_H_
+#define _BLUES_COBS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Max number of bytes needed to COBS encode n bytes */
+#define BLUES_COBS_ENC_SIZE(n) ((n) + ((n) / 254) + 1)
+
+size_t blues_cobs_encoded_len(const uint8_t *data, size_t len);
+size_t blues_cobs_encode(uint8_t *encoded, const uint8_t *data, size_t len, uint8_t eop);
+size_t blues_cobs_decode(uint8_t *decoded, const uint8_t *encoded, size_t len, uint8_t eop);
+
+#endif // _BLUES_COBS_H_
@@ -0,0 +1,222 @@
+/**
+ * @file blues-md5.cpp
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief MD5 checksum for the NoteCard binary buffer
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <string.h>
+#include "blues-md5.h"
+
+/** Shift amounts of the 64 MD5 steps, 4 per round */
+static const uint8_t md5_shift[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+/** Sine table of RFC 1321, constant and stays in flash */
+static const uint32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+/**
+ * @brief Process one 64 byte block
+ *
+ * @param state intermediate digest
+ * @param block 64 bytes
+ */
+static void md5_block(uint32_t *state, const uint8_t *block)
+{
+	uint32_t m[16];
+	for (uint8_t idx = 0; idx < 16; idx++)
+	{
+		m[idx] = (uint32_t)block[idx * 4] | ((uint32_t)block[idx * 4 + 1] << 8) |
+				 ((uint32_t)block[idx * 4 + 2] << 16) | ((uint32_t)block[idx * 4 + 3] << 24);
+	}
+
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+
+	for (uint8_t step = 0; step < 64; step++)
+	{
+		uint32_t f;
+		uint8_t g;
+		switch (step >> 4)
+		{
+		case 0:
+			f = (b & c) | (~b & d);
+			g = step;
+			break;
+		case 1:
+			f = (d & b) | (~d & c);
+			g = (5 * step + 1) & 0x0F;
+			break;
+		case 2:
+			f = b ^ c ^ d;
+			g = (3 * step + 5) & 0x0F;
+			break;
+		default:
+			f = c ^ (b | ~d);
+			g = (7 * step) & 0x0F;
+			break;
+		}
+		uint32_t sum = a + f + md5_k[step] + m[g];
+		uint8_t shift = md5_shift[((step >> 4) << 2) | (step & 0x03)];
+		a = d;
+		d = c;
+		c = b;
+		b = b + ((sum << shift) | (sum >> (32 - shift)));
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+/**
+ * @brief Start an incremental MD5 calculation
+ *
+ * @param ctx MD5 state
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+
+	blues_md5_ctx ctx;
+	uint8_t digest[BLUES_MD5_SIZE];
+
+	void setup()
+	{
+		blues_md5_init(&ctx);
+		// Data can arrive in pieces of any size
+		blues_md5_update(&ctx, (const uint8_t *)"Hel", 3);
+		blues_md5_update(&ctx, (const uint8_t *)"lo", 2);
+		blues_md5_final(&ctx, digest);
+	}
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+void blues_md5_init(blues_md5_ctx *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->count = 0;
+}
+
+/**
+ * @brief Add the next piece of data to the MD5 calculation
+ *
+ * @param ctx MD5 state
+ * @param data bytes to add
+ * @param len number of bytes
+ */
+void blues_md5_update(blues_md5_ctx *ctx, const uint8_t *data, size_t len)
+{
+	size_t used = ctx->count & 0x3F;
+	ctx->count += len;
+
+	// Complete a block with the bytes left from the last call
+	if (used != 0)
+	{
+		size_t fill = 64 - used;
+		if (len < fill)
+		{
+			memcpy(&ctx->buffer[used], data, len);
+			return;
+		}
+		memcpy(&ctx->buffer[used], data, fill);
+		md5_block(ctx->state, ctx->buffer);
+		data += fill;
+		len -= fill;
+	}
+
+	while (len >= 64)
+	{
+		md5_block(ctx->state, data);
+		data += 64;
+		len -= 64;
+	}
+	memcpy(ctx->buffer, data, len);
+}
+
+/**
+ * @brief Finish the MD5 calculation
+ *
+ * @param ctx MD5 state
+ * @param digest (out) MD5 digest, BLUES_MD5_SIZE bytes
+ */
+void blues_md5_final(blues_md5_ctx *ctx, uint8_t *digest)
+{
+	uint64_t bits = ctx->count << 3;
+	size_t used = ctx->count & 0x3F;
+
+	// Padding is 0x80, then 0 bytes up to 56 bytes in the last block
+	ctx->buffer[used++] = 0x80;
+	if (used > 56)
+	{
+		memset(&ctx->buffer[used], 0, 64 - used);
+		md5_block(ctx->state, ctx->buffer);
+		used = 0;
+	}
+	memset(&ctx->buffer[used], 0, 56 - used);
+	for (uint8_t idx = 0; idx < 8; idx++)
+	{
+		ctx->buffer[56 + idx] = (uint8_t)(bits >> (idx * 8));
+	}
+	md5_block(ctx->state, ctx->buffer);
+
+	for (uint8_t idx = 0; idx < 16; idx++)
+	{
+		digest[idx] = (uint8_t)(ctx->state[idx >> 2] >> ((idx & 0x03) * 8));
+	}
+}
+
+/**
+ * @brief Finish the MD5 calculation and get the digest as lower case hex string, as used by the NoteCard
+ *
+ * @param ctx MD5 state
+ * @param hex (out) hex string, needs BLUES_MD5_HEX_SIZE bytes
+ */
+void blues_md5_final_hex(blues_md5_ctx *ctx, char *hex)
+{
+	static const char hex_chars[] = "0123456789abcdef";
+	uint8_t digest[BLUES_MD5_SIZE];
+
+	blues_md5_final(ctx, digest);
+	for (uint8_t idx = 0; idx < BLUES_MD5_SIZE; idx++)
+	{
+		hex[idx * 2] = hex_chars[digest[idx] >> 4];
+		hex[idx * 2 + 1] = hex_chars[digest[idx] & 0x0F];
+	}
+	hex[BLUES_MD5_HEX_SIZE - 1] = 0;
+}
+
+/**
+ * @brief Get the MD5 digest of a byte buffer as lower case hex string
+ *
+ * @param hex (out) hex string, needs BLUES_MD5_HEX_SIZE bytes
+ * @param data bytes
+ * @param len number of bytes
+ */
+void blues_md5_hex(char *hex, const uint8_t *data, size_t len)
+{
+	blues_md5_ctx ctx;
+
+	blues_md5_init(&ctx);
+	blues_md5_update(&ctx, data, len);
+	blues_md5_final_hex(&ctx, hex);
+}
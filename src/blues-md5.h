@@ -0,0 +1,40 @@
+/**
+ * @file blues-md5.h
+ * @author Bernd Giesecke (bernd@giesecke.tk)
+ * @brief MD5 checksum for the NoteCard binary buffer
+ * @version 0.1.0
+ * @date 2023-10-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef _BLUES_MD5_H_
+#define _BLUES_MD5_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Length of an MD5 digest */
+#define BLUES_MD5_SIZE 16
+
+/** Buffer size for an MD5 digest as hex string, including the 0 terminator */
+#define BLUES_MD5_HEX_SIZE 33
+
+/**
+ * @brief State of an incremental MD5 calculation
+ *
+ */
+struct blues_md5_ctx
+{
+	uint32_t state[4];	///< Intermediate digest
+	uint64_t count;		///< Number of bytes processed
+	uint8_t buffer[64]; ///< Bytes waiting for a complete 64 byte block
+};
+
+void blues_md5_init(blues_md5_ctx *ctx);
+void blues_md5_update(blues_md5_ctx *ctx, const uint8_t *data, size_t len);
+void blues_md5_final(blues_md5_ctx *ctx, uint8_t *digest);
+void blues_md5_final_hex(blues_md5_ctx *ctx, char *hex);
+void blues_md5_hex(char *hex, const uint8_t *data, size_t len);
+
+#endif // _BLUES_MD5_H_
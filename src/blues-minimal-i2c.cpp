@@ -17,6 +17,10 @@
 #define i2c_buff 32
 #pragma message "Arduino buff size"
 #endif
+
+volatile bool RAK_BLUES::_attn_fired = false;
+void (*RAK_BLUES::_attn_cb)(void) = NULL;
+
 /**
  * @brief Construct a new RAK_BLUES instance
  *
@@ -50,21 +54,243 @@ RAK_BLUES::RAK_BLUES(byte addr)
 }
 
 /**
- * @brief Restart I2C bus
+ * @brief Recover and restart I2C bus
+ * 		A slave that holds SDA low is freed with up to 9 SCL pulses and a STOP condition,
+ * 		then the bus is restarted with the clock set by set_i2c_clock().
  *
+ * @param failed (optional) true (default) if the transfer failed, false for a restart before another try
  */
-void RAK_BLUES::I2C_RST(void)
+void RAK_BLUES::I2C_RST(bool failed)
 {
+	_i2c_recoveries++;
+	if (failed)
+	{
+		_i2c_errors++;
+	}
+	// Repeated errors in Fast-mode, the wiring does not allow it
+	if (failed && (_i2c_clock > BLUES_I2C_STANDARD) && ((_i2c_errors - _i2c_clock_errors) >= BLUES_I2C_FALLBACK_ERRORS))
+	{
+		BLUES_LOG("BLUES_I2C", "Fall back to %d Hz", BLUES_I2C_STANDARD);
+		_i2c_clock = BLUES_I2C_STANDARD;
+		if (_cfg_state != NULL)
+		{
+			_cfg_state->i2c_clock = _i2c_clock;
+			_cfg_changed = true;
+		}
+	}
 #if WIRE_HAS_END
 	Wire.end();
+#endif
+#if defined(BLUES_I2C_SDA) && defined(BLUES_I2C_SCL)
+	i2c_bus_clear();
 #endif
 	Wire.begin();
+	if (_i2c_clock != 0)
+	{
+		Wire.setClock(_i2c_clock);
+	}
+}
+
+#if defined(BLUES_I2C_SDA) && defined(BLUES_I2C_SCL)
+/**
+ * @brief Set an I2C line like an open drain output
+ *
+ * @param pin GPIO of the line
+ * @param high true to release the line, false to pull it low
+ */
+static void i2c_line(uint8_t pin, bool high)
+{
+	if (high)
+	{
+		pinMode(pin, INPUT_PULLUP);
+	}
+	else
+	{
+		pinMode(pin, OUTPUT);
+		digitalWrite(pin, LOW);
+	}
+	// Half clock period at 100 kHz
+	delayMicroseconds(5);
+}
+
+/**
+ * @brief Free a slave that holds SDA low after an interrupted transfer
+ * 		The slave gets up to 9 SCL pulses to finish the byte it is sending, then a STOP condition
+ * 		resets its state machine. Wire must be stopped, the lines are released at the end.
+ *
+ */
+void RAK_BLUES::i2c_bus_clear(void)
+{
+	i2c_line(BLUES_I2C_SDA, true);
+	i2c_line(BLUES_I2C_SCL, true);
+
+	for (uint8_t pulse = 0; (pulse < 9) && (digitalRead(BLUES_I2C_SDA) == LOW); pulse++)
+	{
+		i2c_line(BLUES_I2C_SCL, false);
+		i2c_line(BLUES_I2C_SCL, true);
+		// Wait for a slave that stretches the clock
+		for (uint8_t wait = 0; (wait < 100) && (digitalRead(BLUES_I2C_SCL) == LOW); wait++)
+		{
+			delayMicroseconds(10);
+		}
+	}
+	if (digitalRead(BLUES_I2C_SDA) == LOW)
+	{
+		BLUES_LOG("BLUES_I2C", "SDA still low after 9 clocks");
+	}
+
+	// STOP, SDA goes high while SCL is high
+	i2c_line(BLUES_I2C_SCL, false);
+	i2c_line(BLUES_I2C_SDA, false);
+	i2c_line(BLUES_I2C_SCL, true);
+	i2c_line(BLUES_I2C_SDA, true);
+}
+#endif
+
+/**
+ * @brief Set the I2C clock and keep it for bus restarts
+ * 		Wire.setClock() alone is lost when the library restarts the bus after an error.
+ *
+ * @param clock_hz I2C clock in Hz, e.g. 100000
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void setup()
+   {
+		Wire.begin();
+		rak_blues.set_i2c_clock(100000);
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+void RAK_BLUES::set_i2c_clock(uint32_t clock_hz)
+{
+	_i2c_clock = clock_hz;
+	_i2c_clock_errors = _i2c_errors;
+	Wire.setClock(clock_hz);
+}
+
+/**
+ * @brief Find the fastest I2C clock that works with the NoteCard
+ * 		Fast-mode 400 kHz is tried first, then Standard-mode 100 kHz. Each clock is verified with ping() and card.version
+ * 		without retries, a NACK or a wrong byte count fails the clock. A clock that worked before is only verified.
+ * 		If Fast-mode causes BLUES_I2C_FALLBACK_ERRORS failed transfers later, the library falls back to 100 kHz.
+ * 		A transfer counts once when all its tries failed or the answer was garbled with wrong byte counts.
+ * 		config_begin() only checks the saved clock with ping(), it negotiates if no clock is saved or the check fails.
+ *
+ * @param saved_hz (optional) clock that worked before, e.g. saved in flash, 0 (default) if unknown
+ * @return uint32_t working clock in Hz, 0 if the NoteCard did not answer at any clock
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void setup()
+   {
+		Wire.begin();
+		uint32_t clock_hz = rak_blues.i2c_negotiate(read_saved_clock());
+		if (clock_hz == 0)
+		{
+			Serial.println("No NoteCard found");
+		}
+		save_clock(clock_hz);
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+uint32_t RAK_BLUES::i2c_negotiate(uint32_t saved_hz)
+{
+	uint32_t clocks[3] = {saved_hz, BLUES_I2C_FAST, BLUES_I2C_STANDARD};
+	for (uint8_t idx = 0; idx < 3; idx++)
+	{
+		uint32_t clock_hz = clocks[idx];
+		if ((clock_hz != BLUES_I2C_FAST) && (clock_hz != BLUES_I2C_STANDARD))
+		{
+			continue;
+		}
+		if ((idx != 0) && (clock_hz == saved_hz))
+		{
+			// Failed already
+			continue;
+		}
+		if (i2c_verify(clock_hz))
+		{
+			return clock_hz;
+		}
+	}
+	// Keep the safe clock for the next tries
+	set_i2c_clock(BLUES_I2C_STANDARD);
+	return 0;
+}
+
+/**
+ * @brief Get the current I2C clock
+ *
+ * @return uint32_t I2C clock in Hz, 0 if never set by the library
+ */
+uint32_t RAK_BLUES::get_i2c_clock(void)
+{
+	return _i2c_clock;
+}
+
+/**
+ * @brief Check if the NoteCard works at an I2C clock
+ *
+ * @param clock_hz I2C clock in Hz
+ * @return true if ping() and card.version succeeded without bus recovery
+ * @return false if the NoteCard did not answer correctly
+ */
+bool RAK_BLUES::i2c_verify(uint32_t clock_hz)
+{
+	set_i2c_clock(clock_hz);
+	uint32_t recoveries = _i2c_recoveries;
+	uint32_t available = 0;
+	bool success = ping(&available);
+	if (success)
+	{
+		// No retries, the first error decides. Not answered from the cache
+		uint8_t tries = _retry_tries;
+		_retry_tries = 1;
+		start_req((char *)"card.version");
+		success = blues_request(in_out_buff, JSON_BUFF_SIZE, NULL, 0);
+		_retry_tries = tries;
+	}
+	success = success && (_i2c_recoveries == recoveries);
+	BLUES_LOG("BLUES_I2C", "%d Hz %s", (int)clock_hz, success ? "works" : "failed");
+	// The errors of the check do not count for the fallback
+	_i2c_clock_errors = _i2c_errors;
+	return success;
+}
+
+/**
+ * @brief Get the number of I2C bus recoveries since the start
+ *
+ * @return uint32_t number of bus recoveries
+ */
+uint32_t RAK_BLUES::get_i2c_recoveries(void)
+{
+	return _i2c_recoveries;
 }
 
 /**
  * @brief Create a request structure to be sent to the NoteCard
  *
  * @param request name of request, e.g. card.wireless
+ * @param idempotent (optional) true (default) if the request can be repeated without side effects
+ * 			If false, send_req() will not repeat the request after it was delivered to the NoteCard,
+ * 			e.g. to avoid duplicate notes from note.add
  * @return true if request could be created
  * @return false if request could not be created
  * @par Example
@@ -91,10 +317,15 @@ void RAK_BLUES::I2C_RST(void)
    }
  * @endcode
  */
-bool RAK_BLUES::start_req(char *request)
+bool RAK_BLUES::start_req(char *request, bool idempotent)
 {
 	note_json.clear();
 	note_json["req"] = request;
+	_idempotent = idempotent;
+	_is_cmd = false;
+	_is_note = (strcmp(request, "note.add") == 0);
+	_payload = NULL;
+	_payload_len = 0;
 	// BLUES_LOG("BLUES","Added string %s", request);
 	// serializeJson(note_json, Serial);
 	// Serial.println("");
@@ -103,6 +334,9 @@ bool RAK_BLUES::start_req(char *request)
 
 /**
  * @brief Send a completed request to the NoteCard.
+ * 		The request is serialized only once. On I2C errors or transient NoteCard errors the same
+ * 		bytes are sent again, with a randomized increasing delay between the tries.
+ * 		See set_retry_policy() for the number of tries and the delays.
  *
  * @param response if not NULL, the response of the Notecard will copied into this buffer
  * @param resp_len max length of buffer for the Notecard response
@@ -134,128 +368,4727 @@ bool RAK_BLUES::start_req(char *request)
  */
 bool RAK_BLUES::send_req(char *response, uint16_t resp_len)
 {
+	if (!template_prepare(true))
+	{
+		return false;
+	}
+	// Check before sending, note_json has the response afterwards
+	bool is_note = _is_note;
+	bool success;
+	if (_cache_rule_count != 0)
+	{
+		success = cache_request(response, resp_len);
+	}
+	else
+	{
+		success = blues_request(in_out_buff, JSON_BUFF_SIZE, response, resp_len);
+	}
+	if (!success)
+	{
+		return false;
+	}
+	if (is_note)
+	{
+		sync_note();
+	}
+	return true;
+}
 
-	// Send the request
-	size_t jsonLen = serializeJson(note_json, in_out_buff, 4096);
-#if BLUES_DEBUG > 0
-	BLUES_LOG("BLUES", "Request: %s", in_out_buff);
-#endif
+/**
+ * @brief Serialize, send and retry the request in note_json, and parse the response
+ *
+ * @param buffer buffer for the serialized request, the response is received behind it
+ * @param size size of the buffer
+ * @param response if not NULL, the response of the Notecard will copied into this buffer
+ * @param resp_len max length of buffer for the Notecard response
+ * @return true if request could be sent and the response does not have "err"
+ * @return false if request could not be sent or the response did have "err"
+ */
+bool RAK_BLUES::blues_request(uint8_t *buffer, size_t size, char *response, uint16_t resp_len)
+{
+	_last_err = BLUES_ERR_NONE;
+	_last_err_str[0] = 0;
 
-	in_out_buff[jsonLen] = '\n';
-	jsonLen += 1;
+	// Serialize the request, the response is received behind it
+	size_t jsonLen = serialize_req(buffer, size);
+	if (jsonLen == 0)
+	{
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+	return blues_exchange(note_json, buffer, jsonLen, size, _idempotent, response, resp_len);
+}
 
-	// Transmit the request in chunks, but also in segments so as not to overwhelm the notecard's interrupt buffers
-	uint8_t *chunk = (uint8_t *)in_out_buff;
-	uint16_t sentInSegment = 0;
-	while (jsonLen > 0)
+/**
+ * @brief Send a serialized request with retries and parse the response
+ *
+ * @param doc JSON document for the response
+ * @param buffer serialized request, the response is received behind it
+ * @param jsonLen length of the serialized request
+ * @param size size of the buffer
+ * @param idempotent true if the request can be repeated after it was delivered
+ * @param response if not NULL, the response of the Notecard will copied into this buffer
+ * @param resp_len max length of buffer for the Notecard response
+ * @return true if request could be sent and the response does not have "err"
+ * @return false if request could not be sent or the response did have "err"
+ */
+bool RAK_BLUES::blues_exchange(JsonDocument &doc, uint8_t *buffer, size_t jsonLen, size_t size, bool idempotent, char *response, uint16_t resp_len)
+{
+	uint8_t *rsp_buff = &buffer[jsonLen];
+	size_t rsp_size = size - jsonLen;
+
+	for (uint8_t try_send = 0; try_send < _retry_tries; try_send++)
 	{
-		// Constrain chunkLen to fit into 16 bits (blues_I2C_TX takes the buffer
-		// size as a uint16_t).
-		uint16_t chunkLen = (jsonLen > 0xFFFF) ? 0xFFFF : jsonLen;
-		// Constrain chunkLen to be <= _I2CMax().
-		chunkLen = (chunkLen > i2c_buff) ? i2c_buff : chunkLen;
+		if (try_send != 0)
+		{
+			retry_delay(try_send);
+			BLUES_LOG("BLUES", "Retry %d", try_send);
+		}
 
-		delay(6);
+		if (!blues_transmit(buffer, jsonLen))
+		{
+			// The request did not reach the NoteCard completely, it is safe to repeat it
+			_last_err = BLUES_ERR_BUS;
+			blues_resync();
+			continue;
+		}
 
-		if (!blues_I2C_TX(_deviceAddress, chunk, chunkLen))
+		if (!blues_receive(rsp_buff, rsp_size))
 		{
-			BLUES_LOG("BLUES", "blues_I2C_TX error");
-			I2C_RST();
-			return false;
+			if (_last_err == BLUES_ERR_PERMANENT)
+			{
+				break;
+			}
+			_last_err = BLUES_ERR_BUS;
+			// The NoteCard might have executed the request already
+			if (!idempotent)
+			{
+				break;
+			}
+			blues_resync();
+			continue;
 		}
-		chunk += chunkLen;
-		jsonLen -= chunkLen;
-		sentInSegment += chunkLen;
-		if (sentInSegment > 250)
+
+		if (parse_rsp(doc, rsp_buff, response, resp_len))
 		{
-			sentInSegment = 0;
-			delay(250);
+			_ping_ok = true;
+			_ping_ms = millis();
+			return true;
 		}
-		delay(20);
+
+		// Repeat only if the NoteCard rejected the request temporarily or the response was garbled
+		if ((_last_err == BLUES_ERR_TRANSIENT) || ((_last_err == BLUES_ERR_BUS) && idempotent))
+		{
+			continue;
+		}
+		break;
 	}
+	return false;
+}
+
+/**
+ * @brief Create a command structure to be sent to the NoteCard
+ * 		A command uses "cmd" instead of "req", the NoteCard does not send a response.
+ * 		Use it for requests where the result is not needed, e.g. to disable features.
+ * 		Add entries with the add_* functions and send it with send_cmd().
+ *
+ * @param request name of request, e.g. card.motion.mode
+ * @return true if command could be created
+ * @return false if command could not be created
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
 
-	memset(in_out_buff, 0, JSON_BUFF_SIZE); // sizeof(blues_response));
+   void setup()
+   {
+		// Disable motion mode, no response is needed
+		if (rak_blues.start_cmd((char *)"card.motion.mode"))
+		{
+			rak_blues.add_bool_entry((char *)"stop", true);
+			rak_blues.send_cmd();
+		}
+   }
 
-	// Loop, building a reply buffer out of received chunks.  We'll build the reply in the same
-	// buffer we used to transmit, and will grow it as necessary.
-	bool receivedNewline = false;
-	size_t jsonbufLen = 0;
-	uint16_t chunkLen = 0;
-	uint32_t startMs = millis();
-	uint8_t *jsonbuf = (uint8_t *)in_out_buff;
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::start_cmd(char *request)
+{
+	note_json.clear();
+	note_json["cmd"] = request;
+	// Only a failed transmission is repeated, the NoteCard did not get the command then
+	_idempotent = true;
+	_is_cmd = true;
+	_is_note = (strcmp(request, "note.add") == 0);
+	_payload = NULL;
+	_payload_len = 0;
+	return true;
+}
 
-	while (true)
+/**
+ * @brief Send a completed command to the NoteCard and return without waiting for a response
+ * 		Only I2C errors during the transmission are detected and retried.
+ * 		Errors of the NoteCard while executing the command are not reported.
+ *
+ * @return true if the command was transmitted
+ * @return false if the command could not be transmitted
+ */
+bool RAK_BLUES::send_cmd(void)
+{
+	_last_err = BLUES_ERR_NONE;
+	_last_err_str[0] = 0;
+
+	if (!template_prepare(true))
 	{
-		// Read the chunk
-		uint32_t available;
-		delay(6);
+		return false;
+	}
+	cache_sent();
+
+	size_t jsonLen = serialize_req(in_out_buff, JSON_BUFF_SIZE);
+	if (jsonLen == 0)
+	{
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
 
-		if (!blues_I2C_RX(_deviceAddress, &jsonbuf[jsonbufLen], chunkLen, &available))
+	for (uint8_t try_send = 0; try_send < _retry_tries; try_send++)
+	{
+		if (try_send != 0)
 		{
-			BLUES_LOG("BLUES", "blues_I2C_RX error");
-			return false;
+			retry_delay(try_send);
+			BLUES_LOG("BLUES", "Retry %d", try_send);
 		}
 
-		// We've now received the chunk
-		jsonbufLen += chunkLen;
-
-		// If the last byte of the chunk is \n, chances are that we're done.  However, just so
-		// that we pull everything pending from the module, we only exit when we've received
-		// a newline AND there's nothing left available from the module.
-		if (jsonbufLen > 0 && jsonbuf[jsonbufLen - 1] == '\n')
+		if (blues_transmit(in_out_buff, jsonLen))
 		{
-			receivedNewline = true;
+			_last_err = BLUES_ERR_NONE;
+			if (_is_note)
+			{
+				sync_note();
+			}
+			return true;
 		}
+		_last_err = BLUES_ERR_BUS;
+		blues_resync();
+	}
+	return false;
+}
 
-		// Constrain chunkLen to fit into 16 bits (blues_I2C_RX takes the buffer
-		// size as a uint16_t).
-		chunkLen = (available > 0xFFFF) ? 0xFFFF : available;
-		// Constrain chunkLen to be <= _I2CMax().
-		chunkLen = (chunkLen > i2c_buff) ? i2c_buff : chunkLen;
+/**
+ * @brief Start a new batch of requests and commands
+ * 		A batch collects several requests and commands and sends them in one pass, separated by newlines.
+ * 		The responses are collected in the same order. This saves the TX pacing and the response
+ * 		polling for each single request, e.g. during the NoteCard setup at boot.
+ * 		The serialized requests are kept in in_out_buff, the responses are received behind them.
+ * 		Do not use send_req() or send_cmd() between batch_begin() and batch_send().
+ *
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void batch_cb(uint8_t idx, bool success)
+   {
+		// The response of entry idx is in note_json
+		Serial.printf("Entry %d %s\n", idx, success ? "OK" : rak_blues.get_last_err_str());
+   }
+
+   void setup()
+   {
+		rak_blues.batch_begin();
+
+		rak_blues.start_cmd((char *)"card.motion.mode");
+		rak_blues.add_bool_entry((char *)"stop", true);
+		rak_blues.batch_add();
+
+		rak_blues.start_req((char *)"hub.set");
+		rak_blues.add_string_entry((char *)"mode", (char *)"minimum");
+		rak_blues.batch_add();
+
+		rak_blues.start_req((char *)"card.version");
+		rak_blues.batch_add();
+
+		if (!rak_blues.batch_send(batch_cb))
+		{
+			Serial.println("Setup failed");
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+void RAK_BLUES::batch_begin(void)
+{
+	_batch_len = 0;
+	_batch_count = 0;
+	_batch_rsp_mask = 0;
+	_batch_idempotent = true;
+}
+
+/**
+ * @brief Add the request or command created with start_req() or start_cmd() to the batch
+ * 		The request is serialized immediately, note_json can be used for the next request.
+ *
+ * @return true if the request was added
+ * @return false if the batch is full or the request does not fit into in_out_buff
+ */
+bool RAK_BLUES::batch_add(void)
+{
+	if (_batch_count >= BLUES_BATCH_MAX)
+	{
+		BLUES_LOG("BLUES", "Batch is full");
+		return false;
+	}
+	if (!template_prepare(true))
+	{
+		return false;
+	}
+	cache_sent();
+	size_t jsonLen = serialize_req(&in_out_buff[_batch_len], JSON_BUFF_SIZE - _batch_len);
+	if (jsonLen == 0)
+	{
+		return false;
+	}
+	_batch_len += jsonLen;
+	if (!_is_cmd)
+	{
+		_batch_rsp_mask |= (1UL << _batch_count);
+	}
+	_batch_idempotent = _batch_idempotent && _idempotent;
+	_batch_count++;
+	return true;
+}
+
+/**
+ * @brief Send all queued requests and commands in one pass and collect the responses
+ * 		The callback is called for each request with a response, in the order of batch_add().
+ * 		During the callback the response is available in note_json.
+ * 		If all requests are idempotent, the whole batch is repeated after a failed transmission, a failed
+ * 		reception or a transient error of a request, with the retry policy of send_req().
+ *
+ * @param callback (optional) called for each request with the index in the batch and the result
+ * @return true if all commands were sent and all requests succeeded
+ * @return false if the transmission failed or at least one request failed
+ */
+bool RAK_BLUES::batch_send(void (*callback)(uint8_t idx, bool success))
+{
+	_last_err = BLUES_ERR_NONE;
+	_last_err_str[0] = 0;
+	_batch_ok_mask = 0;
+
+	if (_batch_count == 0)
+	{
+		return true;
+	}
+
+	uint8_t rsp_count = 0;
+	for (uint8_t idx = 0; idx < _batch_count; idx++)
+	{
+		if ((_batch_rsp_mask & (1UL << idx)) != 0)
+		{
+			rsp_count++;
+		}
+	}
+
+	uint8_t *rsp_buff = &in_out_buff[_batch_len];
+	size_t rsp_size = JSON_BUFF_SIZE - _batch_len;
+	bool received = false;
+
+	for (uint8_t try_send = 0; try_send < _retry_tries; try_send++)
+	{
+		if (try_send != 0)
+		{
+			retry_delay(try_send);
+			BLUES_LOG("BLUES", "Retry %d", try_send);
+		}
+
+		if (!blues_transmit(in_out_buff, _batch_len))
+		{
+			_last_err = BLUES_ERR_BUS;
+			blues_resync();
+			// Some of the requests might have reached the NoteCard already
+			if (!_batch_idempotent)
+			{
+				break;
+			}
+			continue;
+		}
+
+		// Commands are done when they are transmitted
+		for (uint8_t idx = 0; idx < _batch_count; idx++)
+		{
+			if ((_batch_rsp_mask & (1UL << idx)) == 0)
+			{
+				_batch_ok_mask |= (1UL << idx);
+			}
+		}
+
+		if (rsp_count == 0)
+		{
+			batch_begin();
+			return true;
+		}
+
+		received = blues_receive(rsp_buff, rsp_size, rsp_count);
+		if (!received)
+		{
+			if (_last_err == BLUES_ERR_PERMANENT)
+			{
+				break;
+			}
+			_last_err = BLUES_ERR_BUS;
+			// The NoteCard might have executed the requests already
+			if (!_batch_idempotent)
+			{
+				break;
+			}
+			blues_resync();
+			continue;
+		}
+
+		// Repeat the whole batch if a request failed with e.g. {io} or {busy}, the last try is reported as it is
+		if (_batch_idempotent && ((try_send + 1) < _retry_tries) && batch_transient((const char *)rsp_buff, rsp_count))
+		{
+			received = false;
+			_last_err = BLUES_ERR_TRANSIENT;
+			continue;
+		}
+		break;
+	}
+
+	if (!received)
+	{
+		// Report all requests as failed
+		if (callback != NULL)
+		{
+			for (uint8_t idx = 0; idx < _batch_count; idx++)
+			{
+				if ((_batch_rsp_mask & (1UL << idx)) != 0)
+				{
+					callback(idx, false);
+				}
+			}
+		}
+		batch_begin();
+		return false;
+	}
+
+	// Split the responses and parse them one by one
+	bool all_ok = true;
+	blues_err_class first_err = BLUES_ERR_NONE;
+	char *line = (char *)rsp_buff;
+	for (uint8_t idx = 0; idx < _batch_count; idx++)
+	{
+		if ((_batch_rsp_mask & (1UL << idx)) == 0)
+		{
+			continue;
+		}
+		char *line_end = strchr(line, '\n');
+		if (line_end != NULL)
+		{
+			*line_end = 0;
+		}
+		bool success = parse_rsp((uint8_t *)line, NULL, 0);
+		if (success)
+		{
+			_batch_ok_mask |= (1UL << idx);
+		}
+		else
+		{
+			all_ok = false;
+			if (first_err == BLUES_ERR_NONE)
+			{
+				first_err = _last_err;
+			}
+		}
+		if (callback != NULL)
+		{
+			callback(idx, success);
+		}
+		if (line_end == NULL)
+		{
+			line = line + strlen(line);
+		}
+		else
+		{
+			line = line_end + 1;
+		}
+	}
+	// Report the first error of the batch
+	if (first_err != BLUES_ERR_NONE)
+	{
+		_last_err = first_err;
+	}
+	batch_begin();
+	return all_ok;
+}
+
+/**
+ * @brief Check if one of the batch responses has a transient error
+ * 		The responses are only scanned, they stay unchanged for parse_rsp().
+ *
+ * @param rsp received responses, separated by newlines
+ * @param lines number of responses
+ * @return true if at least one response has an "err" classified as transient
+ * @return false if no response has a transient error
+ */
+bool RAK_BLUES::batch_transient(const char *rsp, uint8_t lines)
+{
+	StaticJsonDocument<16> filter;
+	filter["err"] = true;
+	StaticJsonDocument<BLUES_ERR_STR_SIZE + 32> err_doc;
+
+	for (uint8_t idx = 0; (idx < lines) && (*rsp != 0); idx++)
+	{
+		const char *line_end = strchr(rsp, '\n');
+		size_t len = (line_end == NULL) ? strlen(rsp) : (size_t)(line_end - rsp);
+		// The const input is copied, only the "err" entry is kept
+		if (!deserializeJson(err_doc, rsp, len, DeserializationOption::Filter(filter)))
+		{
+			const char *err = err_doc["err"].as<const char *>();
+			if ((err != NULL) && (classify_err(err) == BLUES_ERR_TRANSIENT))
+			{
+				return true;
+			}
+		}
+		if (line_end == NULL)
+		{
+			break;
+		}
+		rsp = line_end + 1;
+	}
+	return false;
+}
+
+/**
+ * @brief FNV-1a hash of a serialized request
+ *
+ * @param data serialized request
+ * @param len length of the request
+ * @return uint32_t hash, never 0, 0 is used for unknown settings
+ */
+static uint32_t blues_hash(const uint8_t *data, size_t len)
+{
+	uint32_t hash = 2166136261UL;
+	for (size_t idx = 0; idx < len; idx++)
+	{
+		hash ^= data[idx];
+		hash *= 16777619UL;
+	}
+	return (hash == 0) ? 1 : hash;
+}
+
+/**
+ * @brief Check if all entries of the requested settings are in the NoteCard response with the same value
+ *
+ * @param desired requested settings
+ * @param actual NoteCard response
+ * @return true if all values match
+ * @return false if a value is missing or different
+ */
+static bool blues_json_match(JsonObject desired, JsonObject actual)
+{
+	for (JsonPair kv : desired)
+	{
+		const char *key = kv.key().c_str();
+		if ((strcmp(key, "req") == 0) || (strcmp(key, "cmd") == 0))
+		{
+			continue;
+		}
+		JsonVariant want = kv.value();
+		JsonVariant have = actual[key];
+		if (have.isNull())
+		{
+			return false;
+		}
+		if (want.is<JsonObject>())
+		{
+			if (!have.is<JsonObject>() || !blues_json_match(want.as<JsonObject>(), have.as<JsonObject>()))
+			{
+				return false;
+			}
+		}
+		else if (want.is<const char *>())
+		{
+			if (!have.is<const char *>() || (strcmp(want.as<const char *>(), have.as<const char *>()) != 0))
+			{
+				return false;
+			}
+		}
+		else if (want.is<bool>())
+		{
+			if (!have.is<bool>() || (want.as<bool>() != have.as<bool>()))
+			{
+				return false;
+			}
+		}
+		else if (want.is<long>())
+		{
+			if (!have.is<long>() || (want.as<long>() != have.as<long>()))
+			{
+				return false;
+			}
+		}
+		else if (want.is<float>())
+		{
+			float diff = want.as<float>() - have.as<float>();
+			if (!have.is<float>() || (diff > 0.0001f) || (diff < -0.0001f))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			// Arrays are not compared, send the request
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Start a configuration pass
+ * 		The configuration manager sends only the settings that changed since they were applied the last time.
+ * 		For each setting request a hash is kept in state, the application saves state in its flash
+ * 		and passes it to config_begin() after the next boot.
+ * 		If check_device is true, card.version is requested to detect a replaced NoteCard,
+ * 		in that case all saved hashes are invalid. Before, the saved I2C clock is checked with ping(), only if
+ * 		it is unknown or fails, the clock is negotiated with i2c_negotiate(). The clock is kept in state.
+ * 		Add the setting requests with start_req(), the add_* functions and config_add(),
+ * 		then send the changed ones with config_apply().
+ *
+ * @param state saved configuration state, all 0 if unknown
+ * @param check_device (optional) true (default) to check the NoteCard device UID with card.version
+ * @return true if the configuration pass was started
+ * @return false if card.version failed, e.g. no NoteCard
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // Saved in flash by the application
+   blues_config_state cfg_state;
+
+   void setup()
+   {
+		read_cfg_state(&cfg_state);
+		if (rak_blues.config_begin(&cfg_state))
+		{
+			rak_blues.start_req((char *)"hub.set");
+			rak_blues.add_string_entry((char *)"product", (char *)"com.my-company.my-name:my-project");
+			rak_blues.add_string_entry((char *)"mode", (char *)"minimum");
+			// Slot 0, read back with hub.get if the state is unknown
+			rak_blues.config_add(0, (char *)"hub.get");
+
+			rak_blues.start_req((char *)"card.motion.mode");
+			rak_blues.add_bool_entry((char *)"stop", true);
+			rak_blues.config_add(1);
+
+			rak_blues.config_apply();
+			if (rak_blues.config_changed())
+			{
+				save_cfg_state(&cfg_state);
+			}
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::config_begin(blues_config_state *state, bool check_device)
+{
+	_cfg_state = state;
+	_cfg_changed = false;
+	_cfg_mask = 0;
+	batch_begin();
+
+	if (!check_device)
+	{
+		return true;
+	}
+
+	// The clock depends on the wiring, it is kept for a new NoteCard.
+	// A saved clock only needs the presence check, card.version below checks the transfers
+	uint32_t i2c_clock = _cfg_state->i2c_clock;
+	uint32_t available = 0;
+	bool clock_ok = false;
+	if ((i2c_clock == BLUES_I2C_FAST) || (i2c_clock == BLUES_I2C_STANDARD))
+	{
+		set_i2c_clock(i2c_clock);
+		clock_ok = ping(&available);
+	}
+	if (!clock_ok)
+	{
+		i2c_clock = i2c_negotiate(i2c_clock);
+		if (i2c_clock == 0)
+		{
+			_last_err = BLUES_ERR_BUS;
+			return false;
+		}
+	}
+	if (i2c_clock != _cfg_state->i2c_clock)
+	{
+		_cfg_state->i2c_clock = i2c_clock;
+		_cfg_changed = true;
+	}
+
+	start_req((char *)"card.version");
+	if (!send_req())
+	{
+		return false;
+	}
+	const char *device = note_json["device"].as<const char *>();
+	if (device == NULL)
+	{
+		device = "";
+	}
+	uint32_t device_hash = blues_hash((const uint8_t *)device, strlen(device));
+	if (device_hash != _cfg_state->device_hash)
+	{
+		BLUES_LOG("BLUES", "New NoteCard %s, settings unknown", device);
+		memset(_cfg_state, 0, sizeof(blues_config_state));
+		_cfg_state->device_hash = device_hash;
+		_cfg_state->i2c_clock = i2c_clock;
+		_cfg_changed = true;
+	}
+	return true;
+}
+
+/**
+ * @brief Add the setting request created with start_req() to the configuration pass
+ * 		The request is skipped if it is the same as the last applied request of this slot.
+ * 		A command created with start_cmd() is sent as request, only a response without "err" confirms
+ * 		that the NoteCard accepted the setting.
+ * 		If the slot is unknown and readback is set, the current settings are requested from the NoteCard
+ * 		and the request is skipped if the NoteCard has the same values already.
+ *
+ * @param slot number of the setting, 0 to BLUES_CONFIG_SLOTS - 1, must be the same after each boot
+ * @param readback (optional) request to read the current settings, e.g. hub.get for hub.set
+ * @return true if the request was queued or is not needed
+ * @return false if the slot is invalid or the request does not fit into the batch
+ */
+bool RAK_BLUES::config_add(uint8_t slot, char *readback)
+{
+	if ((_cfg_state == NULL) || (slot >= BLUES_CONFIG_SLOTS))
+	{
+		return false;
+	}
+
+	if (_is_cmd)
+	{
+		note_json["req"] = note_json["cmd"];
+		note_json.remove("cmd");
+		_is_cmd = false;
+	}
+
+	size_t start = _batch_len;
+	if (!batch_add())
+	{
+		return false;
+	}
+	// Hash without the newline
+	uint32_t hash = blues_hash(&in_out_buff[start], _batch_len - start - 1);
+
+	if (hash == _cfg_state->slot_hash[slot])
+	{
+		BLUES_LOG("BLUES", "Setting %d unchanged", slot);
+		batch_drop_last(start);
+		return true;
+	}
+
+	if ((_cfg_state->slot_hash[slot] == 0) && (readback != NULL) && config_readback(start, readback))
+	{
+		BLUES_LOG("BLUES", "Setting %d already on the NoteCard", slot);
+		batch_drop_last(start);
+		_cfg_state->slot_hash[slot] = hash;
+		_cfg_changed = true;
+		return true;
+	}
+
+	uint8_t idx = _batch_count - 1;
+	_cfg_slot[idx] = slot;
+	_cfg_hash[idx] = hash;
+	_cfg_mask |= (1UL << idx);
+	return true;
+}
+
+/**
+ * @brief Send all changed settings in one batch and save the hashes of the applied settings in the state
+ * 		A hash is only saved for a setting with a response without "err", a rejected setting is sent again
+ * 		in the next configuration pass.
+ *
+ * @param callback (optional) called for each request with the index in the batch and the result
+ * @return true if all changed settings were applied
+ * @return false if at least one setting failed
+ */
+bool RAK_BLUES::config_apply(void (*callback)(uint8_t idx, bool success))
+{
+	uint8_t count = _batch_count;
+	bool result = batch_send(callback);
+	if (_cfg_state != NULL)
+	{
+		for (uint8_t idx = 0; idx < count; idx++)
+		{
+			uint32_t bit = (1UL << idx);
+			// Managed settings are always requests, the OK bit is set only for a confirmed response
+			if (((_cfg_mask & bit) != 0) && ((_batch_ok_mask & bit) != 0))
+			{
+				_cfg_state->slot_hash[_cfg_slot[idx]] = _cfg_hash[idx];
+				_cfg_changed = true;
+			}
+		}
+	}
+	_cfg_mask = 0;
+	return result;
+}
+
+/**
+ * @brief Check if the configuration state changed and should be saved by the application
+ *
+ * @return true if the state changed in the last configuration pass
+ * @return false if the state is unchanged
+ */
+bool RAK_BLUES::config_changed(void)
+{
+	return _cfg_changed;
+}
+
+/**
+ * @brief Remove the last request from the batch
+ *
+ * @param start position of the last request in in_out_buff
+ */
+void RAK_BLUES::batch_drop_last(size_t start)
+{
+	_batch_count--;
+	_batch_len = start;
+	_batch_rsp_mask &= ~(1UL << _batch_count);
+}
+
+/**
+ * @brief Compare the last queued setting request with the current settings of the NoteCard
+ * 		The readback request is serialized behind the queued requests.
+ *
+ * @param start position of the setting request in in_out_buff
+ * @param readback request to read the current settings
+ * @return true if the NoteCard has all values of the setting request
+ * @return false if a value is different or the readback failed
+ */
+bool RAK_BLUES::config_readback(size_t start, char *readback)
+{
+	StaticJsonDocument<BLUES_CONFIG_DOC_SIZE> desired;
+	// Copy the strings, the queued request must stay unchanged
+	if (deserializeJson(desired, (const char *)&in_out_buff[start], _batch_len - start - 1))
+	{
+		return false;
+	}
+
+	start_req(readback);
+	if (!blues_request(&in_out_buff[_batch_len], JSON_BUFF_SIZE - _batch_len, NULL, 0))
+	{
+		return false;
+	}
+	return blues_json_match(desired.as<JsonObject>(), note_json.as<JsonObject>());
+}
+
+/**
+ * @brief Send a request without waiting for the response (pipelining)
+ * 		An "id" is added to the request, the NoteCard copies it into the response.
+ * 		The next request can be sent while the NoteCard is still working on the previous ones,
+ * 		pipe_poll() reads the responses and matches them by the id.
+ * 		Up to BLUES_PIPE_MAX requests can be in flight. Call pipe_flush() before using send_req() again.
+ *
+ * @param id (out, optional) id of the request
+ * @return true if the request was sent
+ * @return false if too many requests are in flight or the request could not be sent
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void pipe_cb(uint32_t id, bool success)
+   {
+		// The response is in note_json
+		Serial.printf("Request %d %s\n", id, success ? "OK" : rak_blues.get_last_err_str());
+   }
+
+   void setup()
+   {
+		for (int idx = 0; idx < 10; idx++)
+		{
+			rak_blues.start_req((char *)"note.add", false);
+			rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
+			rak_blues.add_nested_int32_entry((char *)"body", (char *)"count", idx);
+			while (!rak_blues.pipe_send())
+			{
+				// Too many requests in flight, wait for a response
+				rak_blues.pipe_poll(pipe_cb, 1000);
+			}
+			rak_blues.pipe_poll(pipe_cb);
+		}
+		rak_blues.pipe_flush(pipe_cb);
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::pipe_send(uint32_t *id)
+{
+	_last_err = BLUES_ERR_NONE;
+	_last_err_str[0] = 0;
+
+	if (_pipe_count >= BLUES_PIPE_MAX)
+	{
+		return false;
+	}
+	// The template can only be sent if no responses are pending
+	if (!template_prepare(_pipe_count == 0))
+	{
+		return false;
+	}
+	cache_sent();
+
+	uint32_t req_id = _pipe_next_id++;
+	if (_pipe_next_id == 0)
+	{
+		_pipe_next_id = 1;
+	}
+	note_json["id"] = req_id;
+
+	// Received partial responses are kept at the start of in_out_buff, serialize behind them
+	uint8_t *tx_buff = &in_out_buff[_pipe_rx_len];
+	size_t jsonLen = serialize_req(tx_buff, JSON_BUFF_SIZE - _pipe_rx_len);
+	if (jsonLen == 0)
+	{
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+
+	for (uint8_t try_send = 0; try_send < _retry_tries; try_send++)
+	{
+		if (try_send != 0)
+		{
+			retry_delay(try_send);
+			BLUES_LOG("BLUES", "Retry %d", try_send);
+		}
+
+		if (blues_transmit(tx_buff, jsonLen))
+		{
+			_pipe[_pipe_count].id = req_id;
+			_pipe[_pipe_count].sent_ms = millis();
+			_pipe_count++;
+			if (_is_note)
+			{
+				sync_note();
+			}
+			if (id != NULL)
+			{
+				*id = req_id;
+			}
+			return true;
+		}
+		_last_err = BLUES_ERR_BUS;
+		// A resync would throw away the responses of the requests in flight
+		if (_pipe_count != 0)
+		{
+			break;
+		}
+		blues_resync();
+	}
+	return false;
+}
+
+/**
+ * @brief Read the responses of pipelined requests
+ * 		For each response the callback is called with the id of the request. During the callback the
+ * 		response is available in note_json. Requests without response after 30 seconds are reported as failed.
+ *
+ * @param callback function called for each finished request
+ * @param wait_ms (optional) max time to wait for responses, 0 (default) reads only what is available
+ * @return uint8_t number of finished requests
+ */
+uint8_t RAK_BLUES::pipe_poll(void (*callback)(uint32_t id, bool success), uint32_t wait_ms)
+{
+	uint8_t finished = 0;
+	uint32_t startMs = millis();
+
+	while (_pipe_count != 0)
+	{
+		size_t rx_len = 0;
+		if (!blues_read_available(&in_out_buff[_pipe_rx_len], JSON_BUFF_SIZE - 1 - _pipe_rx_len, &rx_len))
+		{
+			_last_err = BLUES_ERR_BUS;
+		}
+		_pipe_rx_len += rx_len;
+
+		// Handle all complete responses
+		uint8_t *line_end;
+		while ((line_end = (uint8_t *)memchr(in_out_buff, '\n', _pipe_rx_len)) != NULL)
+		{
+			size_t line_len = line_end - in_out_buff + 1;
+			*line_end = 0;
+			bool success = parse_rsp(in_out_buff, NULL, 0);
+			uint32_t rsp_id = note_json["id"].as<uint32_t>();
+			uint8_t idx;
+			for (idx = 0; idx < _pipe_count; idx++)
+			{
+				if (_pipe[idx].id == rsp_id)
+				{
+					break;
+				}
+			}
+			if (idx < _pipe_count)
+			{
+				pipe_remove(idx);
+				finished++;
+				if (callback != NULL)
+				{
+					callback(rsp_id, success);
+				}
+			}
+			else
+			{
+				BLUES_LOG("BLUES", "Response without matching id");
+			}
+			// Keep the rest for the next response
+			_pipe_rx_len -= line_len;
+			memmove(in_out_buff, &in_out_buff[line_len], _pipe_rx_len);
+		}
+
+		if (_pipe_rx_len >= (JSON_BUFF_SIZE - 1))
+		{
+			BLUES_LOG("BLUES", "Pipelined response too large");
+			_pipe_rx_len = 0;
+			_last_err = BLUES_ERR_PERMANENT;
+			blues_resync();
+		}
+
+		// Requests without response
+		for (uint8_t idx = 0; idx < _pipe_count;)
+		{
+			if ((millis() - _pipe[idx].sent_ms) >= 30000)
+			{
+				uint32_t lost_id = _pipe[idx].id;
+				BLUES_LOG("BLUES", "No Response for %d", lost_id);
+				pipe_remove(idx);
+				finished++;
+				_last_err = BLUES_ERR_BUS;
+				if (callback != NULL)
+				{
+					callback(lost_id, false);
+				}
+				continue;
+			}
+			idx++;
+		}
+
+		// Nothing in flight, a partial response left in in_out_buff can not be matched anymore
+		if (_pipe_count == 0)
+		{
+			_pipe_rx_len = 0;
+		}
+
+		if ((millis() - startMs) >= wait_ms)
+		{
+			break;
+		}
+		// Waiting for the NoteCard to process the requests
+		delay(50);
+	}
+	return finished;
+}
+
+/**
+ * @brief Wait until all pipelined requests are finished
+ *
+ * @param callback function called for each finished request
+ * @return uint8_t number of finished requests
+ */
+uint8_t RAK_BLUES::pipe_flush(void (*callback)(uint32_t id, bool success))
+{
+	return pipe_poll(callback, 30000);
+}
+
+/**
+ * @brief Get the number of pipelined requests without response
+ *
+ * @return uint8_t number of requests in flight
+ */
+uint8_t RAK_BLUES::pipe_pending(void)
+{
+	return _pipe_count;
+}
+
+/**
+ * @brief Remove a request from the list of requests in flight
+ *
+ * @param idx index in the list
+ */
+void RAK_BLUES::pipe_remove(uint8_t idx)
+{
+	_pipe_count--;
+	for (; idx < _pipe_count; idx++)
+	{
+		_pipe[idx] = _pipe[idx + 1];
+	}
+}
+
+/**
+ * @brief Set the storage of the request slots
+ * 		The application supplies an array of two slots, each slot has its own buffer for the serialized
+ * 		request and the response and its own JSON document for the response, about
+ * 		BLUES_SLOT_BUFF_SIZE + BLUES_SLOT_DOC_SIZE bytes. Without slot_begin() no RAM is used for the slots
+ * 		and slot_queue() fails. All slots are marked free.
+ *
+ * @param slots array of two request slots, must stay valid while the slots are used
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // Storage of the request slots
+   blues_slot req_slots[2];
+
+   void setup()
+   {
+		rak_blues.slot_begin(req_slots);
+   }
+ * @endcode
+ */
+void RAK_BLUES::slot_begin(blues_slot *slots)
+{
+	_slots = slots;
+	_slot_next = 0;
+	if (_slots != NULL)
+	{
+		_slots[0].state = BLUES_SLOT_FREE;
+		_slots[1].state = BLUES_SLOT_FREE;
+	}
+}
+
+/**
+ * @brief Queue the request created with start_req() in a free request slot
+ * 		There are two request slots set with slot_begin(), each with its own buffer for the serialized request
+ * 		and the response, and its own JSON document for the response. The request is serialized into the slot immediately,
+ * 		note_json is free for the next request while the slot is sent by slot_process().
+ * 		The serialized request must fit into BLUES_SLOT_BUFF_SIZE.
+ * 		Do not use send_req() while a slot is busy.
+ *
+ * @return true if the request was queued
+ * @return false if slot_begin() was not called, both slots are busy or the request does not fit into the slot
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // Storage of the request slots
+   blues_slot req_slots[2];
+
+   void slot_cb(JsonDocument &rsp, bool success)
+   {
+		Serial.printf("note.add %s\n", success ? "OK" : rak_blues.get_last_err_str());
+   }
+
+   void setup()
+   {
+		rak_blues.slot_begin(req_slots);
+   }
+
+   void loop()
+   {
+		// Compose the next note while the previous one is on the bus
+		if (rak_blues.slot_free() != 0)
+		{
+			rak_blues.start_req((char *)"note.add", false);
+			rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
+			rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", read_temperature());
+			rak_blues.slot_queue();
+		}
+		// One bus step per call, never blocks for long
+		rak_blues.slot_process(slot_cb);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::slot_queue(void)
+{
+	if (_slots == NULL)
+	{
+		BLUES_LOG("BLUES", "No request slots, call slot_begin()");
+		return false;
+	}
+
+	// Use the slots in turns
+	uint8_t idx = _slot_next;
+	if (_slots[idx].state != BLUES_SLOT_FREE)
+	{
+		idx ^= 1;
+		if (_slots[idx].state != BLUES_SLOT_FREE)
+		{
+			return false;
+		}
+	}
+
+	// The template can only be sent if no slot is on the bus
+	if (!template_prepare(slot_free() == 2))
+	{
+		return false;
+	}
+	cache_sent();
+
+	blues_slot *slot = &_slots[idx];
+	slot->len = serialize_req(slot->buff, BLUES_SLOT_BUFF_SIZE);
+	if (slot->len == 0)
+	{
+		return false;
+	}
+	slot->idempotent = _idempotent;
+	slot->is_cmd = _is_cmd;
+	slot->tries = 0;
+	slot->seq = _slot_seq++;
+	slot->state = BLUES_SLOT_QUEUED;
+	_slot_next = idx ^ 1;
+	if (_is_note)
+	{
+		sync_note();
+	}
+	return true;
+}
+
+/**
+ * @brief Get the number of free request slots
+ *
+ * @return uint8_t 0, 1 or 2, 0 if slot_begin() was not called
+ */
+uint8_t RAK_BLUES::slot_free(void)
+{
+	if (_slots == NULL)
+	{
+		return 0;
+	}
+	return ((_slots[0].state == BLUES_SLOT_FREE) ? 1 : 0) + ((_slots[1].state == BLUES_SLOT_FREE) ? 1 : 0);
+}
+
+/**
+ * @brief Do the next step of sending the queued request slots, without blocking
+ * 		Each call sends or receives at most one I2C chunk. The pacing delays between the chunks and
+ * 		the wait for the response are timestamps, not delays, the application can do other work meanwhile.
+ * 		The slots are sent in the order they were queued.
+ * 		Retries follow the same rules and the same policy as send_req().
+ *
+ * @param callback (optional) called when a request is finished, with the response of the slot
+ * @return true if a slot is still busy, call slot_process() again
+ * @return false if all slots are free
+ */
+bool RAK_BLUES::slot_process(void (*callback)(JsonDocument &rsp, bool success))
+{
+	if (_slots == NULL)
+	{
+		return false;
+	}
+
+	// Find the active slot, or the oldest queued one
+	blues_slot *slot = NULL;
+	for (uint8_t idx = 0; idx < 2; idx++)
+	{
+		blues_slot *check = &_slots[idx];
+		if ((check->state == BLUES_SLOT_TX) || (check->state == BLUES_SLOT_RX))
+		{
+			slot = check;
+			break;
+		}
+		if ((check->state == BLUES_SLOT_QUEUED) && ((slot == NULL) || ((int32_t)(check->seq - slot->seq) < 0)))
+		{
+			slot = check;
+		}
+	}
+	if (slot == NULL)
+	{
+		return false;
+	}
+	if ((int32_t)(millis() - slot->next_ms) < 0)
+	{
+		return true;
+	}
+
+	switch (slot->state)
+	{
+	case BLUES_SLOT_QUEUED:
+		_last_err = BLUES_ERR_NONE;
+		_last_err_str[0] = 0;
+		slot->pos = 0;
+		slot->segment = 0;
+		slot->rsp.clear();
+		slot->state = BLUES_SLOT_TX;
+		// fall through
+	case BLUES_SLOT_TX:
+	{
+		uint16_t chunkLen = ((slot->len - slot->pos) > i2c_buff) ? i2c_buff : (slot->len - slot->pos);
+		if (!blues_I2C_TX(_deviceAddress, &slot->buff[slot->pos], chunkLen))
+		{
+			// The request did not reach the NoteCard completely, it is safe to repeat it
+			_last_err = BLUES_ERR_BUS;
+			blues_resync();
+			slot_retry(slot, true, callback);
+			break;
+		}
+		slot->pos += chunkLen;
+		slot->segment += chunkLen;
+		// Same pacing as blues_transmit()
+		slot->next_ms = millis() + 26;
+		if (slot->segment > 250)
+		{
+			slot->segment = 0;
+			slot->next_ms += 250;
+		}
+		if (slot->pos >= slot->len)
+		{
+			if (slot->is_cmd)
+			{
+				slot_finish(slot, true, callback);
+				break;
+			}
+			// The response is received behind the request, the request stays for a retry
+			slot->pos = 0;
+			slot->rx_avail = 0;
+			slot->start_ms = millis();
+			slot->state = BLUES_SLOT_RX;
+		}
+		break;
+	}
+	case BLUES_SLOT_RX:
+	{
+		uint16_t chunkLen = (slot->rx_avail > i2c_buff) ? i2c_buff : slot->rx_avail;
+		uint8_t *rsp_buff = &slot->buff[slot->len];
+		if ((slot->len + slot->pos + chunkLen) >= BLUES_SLOT_BUFF_SIZE)
+		{
+			BLUES_LOG("BLUES", "Slot response too large");
+			_last_err = BLUES_ERR_PERMANENT;
+			blues_resync();
+			slot_finish(slot, false, callback);
+			break;
+		}
+		uint32_t available = 0;
+		if (!blues_I2C_RX(_deviceAddress, &rsp_buff[slot->pos], chunkLen, &available))
+		{
+			_last_err = BLUES_ERR_BUS;
+			blues_resync();
+			// The NoteCard might have executed the request already
+			slot_retry(slot, slot->idempotent, callback);
+			break;
+		}
+		slot->pos += chunkLen;
+		slot->rx_avail = available;
+
+		if (available != 0)
+		{
+			slot->next_ms = millis() + 6;
+			break;
+		}
+		if ((slot->pos != 0) && (rsp_buff[slot->pos - 1] == '\n'))
+		{
+			rsp_buff[slot->pos] = 0;
+			BLUES_LOG("BLUES", "Slot response: %s", rsp_buff);
+			if (parse_rsp(slot->rsp, rsp_buff, NULL, 0))
+			{
+				slot_finish(slot, true, callback);
+			}
+			else
+			{
+				// Repeat only if the NoteCard rejected the request temporarily or the response was garbled
+				slot_retry(slot, (_last_err == BLUES_ERR_TRANSIENT) || ((_last_err == BLUES_ERR_BUS) && slot->idempotent), callback);
+			}
+			break;
+		}
+		if ((millis() - slot->start_ms) >= 30000)
+		{
+			BLUES_LOG("BLUES", "No Response");
+			_last_err = BLUES_ERR_BUS;
+			slot_retry(slot, slot->idempotent, callback);
+			break;
+		}
+		// Waiting for the NoteCard to process the request
+		slot->next_ms = millis() + 50;
+		break;
+	}
+	default:
+		break;
+	}
+	return true;
+}
+
+/**
+ * @brief Repeat the request of a slot after the retry delay, or finish it as failed
+ *
+ * @param slot request slot
+ * @param can_retry true if the request can be repeated
+ * @param callback called if the request failed
+ */
+void RAK_BLUES::slot_retry(blues_slot *slot, bool can_retry, void (*callback)(JsonDocument &rsp, bool success))
+{
+	slot->tries++;
+	if (!can_retry || (slot->tries >= _retry_tries))
+	{
+		slot_finish(slot, false, callback);
+		return;
+	}
+	BLUES_LOG("BLUES", "Retry %d", slot->tries);
+	// The request is still in the slot
+	slot->pos = 0;
+	slot->segment = 0;
+	slot->next_ms = millis() + retry_wait_ms(slot->tries);
+	slot->state = BLUES_SLOT_TX;
+}
+
+/**
+ * @brief Finish a slot, call the callback and free the slot
+ *
+ * @param slot request slot
+ * @param success result of the request
+ * @param callback called with the response of the slot, empty if no response was received
+ */
+void RAK_BLUES::slot_finish(blues_slot *slot, bool success, void (*callback)(JsonDocument &rsp, bool success))
+{
+	if (callback != NULL)
+	{
+		callback(slot->rsp, success);
+	}
+	slot->state = BLUES_SLOT_FREE;
+}
+
+/**
+ * @brief Start collecting samples in the sample buffer
+ * 		Instead of sending one note.add per sample, the note bodies are kept in a RAM ring buffer
+ * 		supplied by the application and sent together when a flush threshold is reached.
+ * 		BLUES_SAMPLE_BUFF_SIZE (1024) bytes are a good start, each sample needs its serialized body plus 9 bytes.
+ * 		As array, all samples go in one note.add with the body {"samples":[...]}.
+ * 		As burst, each sample is sent as its own note.add, all of them in one batch.
+ * 		The array body does not fit a note.template, a Notefile with a template needs burst.
+ * 		If the buffer is full, the oldest sample is dropped.
+ *
+ * @param file Notefile for the samples, e.g. "data.qo"
+ * @param buffer RAM for the sample ring buffer, must stay valid while samples are collected
+ * @param size size of buffer in bytes
+ * @param burst (optional) false (default) to send the samples as array in one note, true to send one note per sample
+ * @param sync (optional) true to sync with NoteHub after each flush, default false
+ * @return true if the sample buffer is set up
+ * @return false if the samples are sent as array and the Notefile has a template, the sample buffer is not changed
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // RAM for the samples waiting for a flush
+   uint8_t sample_buff[BLUES_SAMPLE_BUFF_SIZE];
+
+   void setup()
+   {
+		rak_blues.sample_begin((char *)"data.qo", sample_buff, sizeof(sample_buff));
+		// Flush after 10 samples, 512 bytes or when the oldest sample is 1 hour old
+		rak_blues.sample_set_flush(10, 512, 3600);
+   }
+
+   void loop()
+   {
+		rak_blues.start_req((char *)"note.add", false);
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", read_temperature());
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"humid", read_humidity());
+		// Flushes automatically when a threshold is reached
+		rak_blues.sample_add();
+		delay(60000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::sample_begin(char *file, uint8_t *buffer, size_t size, bool burst, bool sync)
+{
+	if (!burst)
+	{
+		for (uint8_t idx = 0; idx < _tpl_count; idx++)
+		{
+			if (strcmp(_tpl[idx].file, file) == 0)
+			{
+				snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "template: samples array in %s", file);
+				_last_err = BLUES_ERR_PERMANENT;
+				BLUES_LOG("BLUES", "%s", _last_err_str);
+				return false;
+			}
+		}
+	}
+
+	snprintf(_sample_file, sizeof(_sample_file), "%s", file);
+	_sample_buff = buffer;
+	_sample_size = (buffer != NULL) ? size : 0;
+	_sample_burst = burst;
+	_sample_sync = sync;
+	_sample_head = 0;
+	_sample_tail = 0;
+	_sample_end = _sample_size;
+	_sample_wrapped = false;
+	_sample_count = 0;
+	_sample_pending = 0;
+	_sample_bytes = 0;
+	return true;
+}
+
+/**
+ * @brief Set the flush thresholds of the sample buffer
+ * 		A threshold of 0 is not checked. The age is checked by sample_add() and sample_due(),
+ * 		call sample_due() from a timer if samples are added rarely.
+ *
+ * @param max_count flush when this number of samples is waiting
+ * @param max_bytes (optional) flush when the serialized samples have this size
+ * @param max_age_s (optional) flush when the oldest sample is older than this in seconds
+ */
+void RAK_BLUES::sample_set_flush(uint16_t max_count, size_t max_bytes, uint32_t max_age_s)
+{
+	_sample_max_count = max_count;
+	_sample_max_bytes = max_bytes;
+	_sample_max_age_ms = max_age_s * 1000;
+}
+
+/**
+ * @brief Add the body of the note created with start_req() and the add_nested_* functions to the sample buffer
+ * 		Only the "body" object is kept, the Notefile and the sync flag are set with sample_begin().
+ * 		Binary payloads are not supported, note_json must not have a payload entry.
+ * 		If a flush threshold is reached, the samples are flushed before returning.
+ *
+ * @return true if the sample was added, a failed flush keeps the samples in the buffer
+ * @return false if sample_begin() was not called, there is no body or it is larger than the sample buffer
+ */
+bool RAK_BLUES::sample_add(void)
+{
+	if (_sample_buff == NULL)
+	{
+		BLUES_LOG("BLUES", "No sample buffer, call sample_begin()");
+		return false;
+	}
+	JsonObject body = note_json["body"];
+	if (body.isNull())
+	{
+		BLUES_LOG("BLUES", "No body for the sample");
+		return false;
+	}
+	if (_time_stamp_samples && _time_valid && !body.containsKey("time"))
+	{
+		body["time"] = time_now();
+	}
+	size_t len = measureJson(body);
+	// Space for the 0 terminator written by serializeJson()
+	size_t need = sizeof(blues_sample_hdr) + len + 1;
+	if (need > _sample_size)
+	{
+		BLUES_LOG("BLUES", "Sample too large");
+		return false;
+	}
+
+	// Find contiguous space, drop the oldest samples if the buffer is full
+	while (true)
+	{
+		if (!_sample_wrapped)
+		{
+			if ((_sample_size - _sample_tail) >= need)
+			{
+				break;
+			}
+			if (_sample_head >= need)
+			{
+				// Continue at the start of the buffer
+				_sample_end = _sample_tail;
+				_sample_tail = 0;
+				_sample_wrapped = true;
+				break;
+			}
+		}
+		else if ((_sample_head - _sample_tail) >= need)
+		{
+			break;
+		}
+		BLUES_LOG("BLUES", "Sample buffer full, drop oldest sample");
+		sample_pop();
+	}
+
+	blues_sample_hdr hdr;
+	hdr.len = (uint16_t)len;
+	hdr.sent = 0;
+	hdr.rsv = 0;
+	hdr.ms = millis();
+	memcpy(&_sample_buff[_sample_tail], &hdr, sizeof(blues_sample_hdr));
+	serializeJson(body, (char *)&_sample_buff[_sample_tail + sizeof(blues_sample_hdr)], len + 1);
+	_sample_tail += need;
+	_sample_count++;
+	_sample_pending++;
+	_sample_bytes += len;
+
+	if (sample_due())
+	{
+		sample_flush();
+	}
+	return true;
+}
+
+/**
+ * @brief Check if a flush threshold of the sample buffer is reached
+ *
+ * @return true if the samples should be flushed
+ * @return false if no threshold is reached or the buffer is empty
+ */
+bool RAK_BLUES::sample_due(void)
+{
+	if (_sample_pending == 0)
+	{
+		return false;
+	}
+	if ((_sample_max_count != 0) && (_sample_pending >= _sample_max_count))
+	{
+		return true;
+	}
+	if ((_sample_max_bytes != 0) && (_sample_bytes >= _sample_max_bytes))
+	{
+		return true;
+	}
+	if (_sample_max_age_ms != 0)
+	{
+		// Sent samples are removed from the head, the head is the oldest waiting sample
+		blues_sample_hdr hdr;
+		memcpy(&hdr, &_sample_buff[_sample_head], sizeof(blues_sample_hdr));
+		if ((uint32_t)(millis() - hdr.ms) >= _sample_max_age_ms)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Get the number of samples waiting in the sample buffer
+ *
+ * @return uint16_t number of samples not sent yet
+ */
+uint16_t RAK_BLUES::sample_count(void)
+{
+	return _sample_pending;
+}
+
+/**
+ * @brief Send all waiting samples now
+ * 		The samples are sent in as few requests as possible, limited by JSON_BUFF_SIZE and BLUES_BATCH_MAX.
+ * 		BLUES_RSP_RESERVE bytes are kept for the response, a failed request means the samples were not added.
+ * 		Sent samples are removed, failed samples stay in the buffer for the next flush.
+ * 		note_json, in_out_buff and the batch are used, do not call it while a batch is collected.
+ *
+ * @return true if all samples were sent
+ * @return false if a request failed
+ */
+bool RAK_BLUES::sample_flush(void)
+{
+	while (_sample_pending != 0)
+	{
+		if (!(_sample_burst ? sample_send_burst() : sample_send_array()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Send as many waiting samples as fit into one note.add with an array body
+ *
+ * @return true if the note was sent
+ * @return false if note.add failed
+ */
+bool RAK_BLUES::sample_send_array(void)
+{
+	start_req((char *)"note.add", false);
+	add_string_entry((char *)"file", _sample_file);
+	if (_sample_sync)
+	{
+		add_bool_entry((char *)"sync", true);
+	}
+	JsonArray samples = note_json.createNestedObject("body").createNestedArray("samples");
+	// Newline and margin for the serialized request
+	size_t used = measureJson(note_json) + 2;
+
+	uint16_t sent = 0;
+	size_t pos = _sample_head;
+	for (uint16_t idx = 0; idx < _sample_count; idx++)
+	{
+		blues_sample_hdr hdr;
+		pos = sample_read(pos, &hdr);
+		if (hdr.sent == 0)
+		{
+			// Body plus the separating comma, the response is received behind the request
+			if ((used + hdr.len + 1) > (JSON_BUFF_SIZE - BLUES_RSP_RESERVE))
+			{
+				break;
+			}
+			if (!samples.add(serialized((const char *)&_sample_buff[pos + sizeof(blues_sample_hdr)], hdr.len)))
+			{
+				break;
+			}
+			used += hdr.len + 1;
+			sent++;
+		}
+		pos += sizeof(blues_sample_hdr) + hdr.len + 1;
+	}
+
+	if (sent == 0)
+	{
+		// A single sample does not fit into a request, it can never be sent
+		BLUES_LOG("BLUES", "Sample does not fit into a request, dropped");
+		sample_mark_sent(1);
+		return true;
+	}
+
+	BLUES_LOG("BLUES", "Flush %d samples as array", sent);
+	if (!send_req())
+	{
+		return false;
+	}
+	sample_mark_sent(sent);
+	return true;
+}
+
+/**
+ * @brief Send as many waiting samples as fit into one batch, one note.add per sample
+ *
+ * @return true if all notes were sent
+ * @return false if at least one note.add failed
+ */
+bool RAK_BLUES::sample_send_burst(void)
+{
+	// Keep one batch entry for hub.sync
+	uint8_t max_notes = _sample_sync ? (BLUES_BATCH_MAX - 1) : BLUES_BATCH_MAX;
+	batch_begin();
+
+	uint16_t added = 0;
+	size_t pos = _sample_head;
+	for (uint16_t idx = 0; (idx < _sample_count) && (added < max_notes); idx++)
+	{
+		blues_sample_hdr hdr;
+		pos = sample_read(pos, &hdr);
+		if (hdr.sent == 0)
+		{
+			start_req((char *)"note.add", false);
+			add_string_entry((char *)"file", _sample_file);
+			note_json["body"] = serialized((const char *)&_sample_buff[pos + sizeof(blues_sample_hdr)], hdr.len);
+			size_t start = _batch_len;
+			if (!batch_add())
+			{
+				break;
+			}
+			// Keep space for the short note.add responses
+			if ((JSON_BUFF_SIZE - _batch_len) < ((size_t)(added + 2) * 32))
+			{
+				batch_drop_last(start);
+				break;
+			}
+			added++;
+		}
+		pos += sizeof(blues_sample_hdr) + hdr.len + 1;
+	}
+
+	if (added == 0)
+	{
+		BLUES_LOG("BLUES", "Sample does not fit into a request, dropped");
+		sample_mark_sent(1);
+		batch_begin();
+		return true;
+	}
+
+	if (_sample_sync)
+	{
+		start_cmd((char *)"hub.sync");
+		batch_add();
+	}
+
+	BLUES_LOG("BLUES", "Flush %d samples as burst", added);
+	bool result = batch_send();
+
+	// Remove the samples that were accepted, even if others failed
+	uint16_t pending = _sample_pending;
+	sample_mark_sent(added, ~_batch_ok_mask);
+	sync_note(pending - _sample_pending);
+	return result;
+}
+
+/**
+ * @brief Read the header of the sample at pos, continue at the start of the buffer at the wrap point
+ *
+ * @param pos position of the sample
+ * @param hdr (out) header of the sample
+ * @return size_t position of the sample after the wrap check
+ */
+size_t RAK_BLUES::sample_read(size_t pos, blues_sample_hdr *hdr)
+{
+	if (_sample_wrapped && (pos == _sample_end))
+	{
+		pos = 0;
+	}
+	memcpy(hdr, &_sample_buff[pos], sizeof(blues_sample_hdr));
+	return pos;
+}
+
+/**
+ * @brief Mark the first waiting samples as sent and remove them from the head of the buffer
+ *
+ * @param count number of waiting samples that were in the request
+ * @param skip_mask (optional) bit n is set if waiting sample n failed and stays in the buffer
+ */
+void RAK_BLUES::sample_mark_sent(uint16_t count, uint32_t skip_mask)
+{
+	size_t pos = _sample_head;
+	uint16_t waiting = 0;
+	for (uint16_t idx = 0; (idx < _sample_count) && (waiting < count); idx++)
+	{
+		blues_sample_hdr hdr;
+		pos = sample_read(pos, &hdr);
+		if (hdr.sent == 0)
+		{
+			if ((waiting >= 32) || ((skip_mask & (1UL << waiting)) == 0))
+			{
+				_sample_buff[pos + offsetof(blues_sample_hdr, sent)] = 1;
+				_sample_pending--;
+				_sample_bytes -= hdr.len;
+			}
+			waiting++;
+		}
+		pos += sizeof(blues_sample_hdr) + hdr.len + 1;
+	}
+	while ((_sample_count != 0) && (_sample_buff[_sample_head + offsetof(blues_sample_hdr, sent)] != 0))
+	{
+		sample_pop();
+	}
+}
+
+/**
+ * @brief Remove the oldest sample from the sample buffer
+ *
+ */
+void RAK_BLUES::sample_pop(void)
+{
+	blues_sample_hdr hdr;
+	_sample_head = sample_read(_sample_head, &hdr);
+	if (hdr.sent == 0)
+	{
+		_sample_pending--;
+		_sample_bytes -= hdr.len;
+	}
+	_sample_head += sizeof(blues_sample_hdr) + hdr.len + 1;
+	_sample_count--;
+	if (_sample_wrapped && (_sample_head == _sample_end))
+	{
+		_sample_head = 0;
+		_sample_end = _sample_size;
+		_sample_wrapped = false;
+	}
+	if (_sample_count == 0)
+	{
+		// Start again at the beginning, keeps the largest contiguous space
+		_sample_head = 0;
+		_sample_tail = 0;
+		_sample_end = _sample_size;
+		_sample_wrapped = false;
+	}
+}
+
+/**
+ * @brief Start the sync scheduler
+ * 		Instead of forcing a sync with "sync":true on every note, the scheduler counts the outbound notes
+ * 		and sends hub.sync only when the policy requires it: the oldest note waits longer than max_delay_s,
+ * 		max_pending notes are waiting, or a note was marked urgent with sync_note().
+ * 		Notes sent with note.add through send_req(), send_cmd(), pipe_send(), slot_queue() or the sample buffer
+ * 		are counted automatically.
+ * 		If outbound_min is not 0, hub.set sets the outbound interval and the NoteCard syncs on its own
+ * 		in periodic or continuous mode, the scheduler forces a sync only if that is not soon enough.
+ *
+ * @param max_delay_s max time a note waits for a sync in seconds, 0 to disable
+ * @param max_pending (optional) max number of notes waiting for a sync, 0 (default) to disable
+ * @param outbound_min (optional) outbound sync interval of the NoteCard in minutes, 0 (default) to keep the NoteCard setting
+ * @return true if the scheduler was started
+ * @return false if hub.set failed
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void setup()
+   {
+		// Sync at the latest 1 hour after the first note or when 10 notes are waiting
+		rak_blues.sync_begin(3600, 10);
+   }
+
+   void loop()
+   {
+		rak_blues.start_req((char *)"note.add", false);
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", read_temperature());
+		rak_blues.send_req();
+		// Alarm notes are synced immediately
+		if (read_temperature() > 50.0)
+		{
+			rak_blues.sync_note(0, true);
+		}
+		rak_blues.sync_process();
+		delay(60000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::sync_begin(uint32_t max_delay_s, uint16_t max_pending, uint16_t outbound_min)
+{
+	_sync_max_delay_ms = max_delay_s * 1000;
+	_sync_max_pending = max_pending;
+	_sync_pending = 0;
+	_sync_urgent = false;
+	if (outbound_min != 0)
+	{
+		start_req((char *)"hub.set");
+		add_int32_entry((char *)"outbound", outbound_min);
+		return send_req();
+	}
+	return true;
+}
+
+/**
+ * @brief Count outbound notes for the sync scheduler
+ * 		Notes sent with send_req(), send_cmd(), pipe_send(), slot_queue() or the sample buffer are counted automatically,
+ * 		call it for notes sent in a batch.
+ *
+ * @param count number of notes, can be 0 to only mark the pending notes as urgent
+ * @param urgent (optional) true to sync with the next sync_process(), default false
+ */
+void RAK_BLUES::sync_note(uint16_t count, bool urgent)
+{
+	uint32_t now = millis();
+	if (count != 0)
+	{
+		if (_sync_pending == 0)
+		{
+			_sync_first_ms = now;
+		}
+		_sync_pending += count;
+		_sync_last_ms = now;
+	}
+	if (urgent)
+	{
+		_sync_urgent = true;
+	}
+}
+
+/**
+ * @brief Get the number of notes waiting for a sync
+ *
+ * @return uint16_t number of notes counted since the last sync
+ */
+uint16_t RAK_BLUES::sync_pending(void)
+{
+	return _sync_pending;
+}
+
+/**
+ * @brief Check the sync policy and send hub.sync if it is required
+ * 		Call it after sending notes and from a timer. It does not access the NoteCard unless the policy requires a sync.
+ * 		Before the sync, hub.sync.status is checked. If the NoteCard synced on its own after the last note
+ * 		was added, the notes are done without a new sync. If a sync is running or requested already,
+ * 		no second sync is started.
+ *
+ * @return true if hub.sync was sent
+ * @return false if no sync was required or the NoteCard is syncing already or the request failed
+ */
+bool RAK_BLUES::sync_process(void)
+{
+	if (_sync_pending == 0)
+	{
+		_sync_urgent = false;
+		return false;
+	}
+
+	uint32_t now = millis();
+	bool due = _sync_urgent;
+	if ((_sync_max_pending != 0) && (_sync_pending >= _sync_max_pending))
+	{
+		due = true;
+	}
+	if ((_sync_max_delay_ms != 0) && ((uint32_t)(now - _sync_first_ms) >= _sync_max_delay_ms))
+	{
+		due = true;
+	}
+	if (!due)
+	{
+		return false;
+	}
+
+	if (start_req((char *)"hub.sync.status") && send_req())
+	{
+		uint32_t completed;
+		if (get_uint32_entry((char *)"completed", completed) && (completed < ((uint32_t)(now - _sync_last_ms) / 1000)))
+		{
+			BLUES_LOG("BLUES", "NoteCard synced %ds ago, no sync needed", (int)completed);
+			_sync_pending = 0;
+			_sync_urgent = false;
+			return false;
+		}
+		bool syncing = false;
+		get_bool_entry((char *)"sync", syncing);
+		if (syncing || has_entry((char *)"requested"))
+		{
+			BLUES_LOG("BLUES", "NoteCard is syncing already");
+			return false;
+		}
+	}
+
+	BLUES_LOG("BLUES", "Sync %d notes", _sync_pending);
+	start_req((char *)"hub.sync");
+	if (!send_req())
+	{
+		return false;
+	}
+	// The connection state changes with the sync
+	cache_invalidate((char *)"hub.status");
+	_sync_pending = 0;
+	_sync_urgent = false;
+	return true;
+}
+
+/**
+ * @brief Declare the body schema of a Notefile for note.template
+ * 		With a template the NoteCard stores the notes of the Notefile in a compact binary form
+ * 		and sends less data to NoteHub. The template is sent with note.template the first time a note.add
+ * 		for the Notefile is sent, afterwards every note.add body for the Notefile is checked against the schema
+ * 		before it is sent. The fields array must stay valid, e.g. static const.
+ * 		The Notefile of a sample buffer that sends the samples as array can not have a template.
+ *
+ * @param file Notefile of the template, e.g. "data.qo"
+ * @param fields body fields with name, type and size
+ * 			BLUES_FIELD_STRING max length in bytes
+ * 			BLUES_FIELD_INT, BLUES_FIELD_UINT 1, 2, 3 or 4 bytes, BLUES_FIELD_INT also 8 bytes
+ * 			BLUES_FIELD_FLOAT 2, 4 or 8 bytes
+ * 			BLUES_FIELD_BOOL size is ignored
+ * @param count number of fields
+ * @param payload_len (optional) max length of the binary payload, 0 (default) if there is no payload
+ * @return int8_t index of the template, -1 if the registry is full, a field is invalid
+ * 			or the sample buffer sends an array to the Notefile
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   static const blues_template_field data_fields[] = {
+	   {"dev_eui", BLUES_FIELD_STRING, 16},
+	   {"temp", BLUES_FIELD_FLOAT, 4},
+	   {"humid", BLUES_FIELD_FLOAT, 4},
+	   {"baro", BLUES_FIELD_FLOAT, 4}};
+
+   void setup()
+   {
+		rak_blues.template_add((char *)"data.qo", data_fields, 4, 32);
+   }
+
+   void loop()
+   {
+		rak_blues.start_req((char *)"note.add", false);
+		rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", read_temperature());
+		// note.template is sent before the first note, a body that does not match is not sent
+		if (!rak_blues.send_req())
+		{
+			Serial.println(rak_blues.get_last_err_str());
+		}
+		delay(60000);
+   }
+ * @endcode
+ */
+int8_t RAK_BLUES::template_add(char *file, const blues_template_field *fields, uint8_t count, uint16_t payload_len)
+{
+	if (_tpl_count >= BLUES_TEMPLATE_MAX)
+	{
+		BLUES_LOG("BLUES", "Template registry is full");
+		return -1;
+	}
+	// The {"samples":[...]} body of an array flush would fail the template check
+	if ((_sample_buff != NULL) && !_sample_burst && (strcmp(_sample_file, file) == 0))
+	{
+		snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "template: samples array in %s", file);
+		_last_err = BLUES_ERR_PERMANENT;
+		BLUES_LOG("BLUES", "%s", _last_err_str);
+		return -1;
+	}
+	for (uint8_t idx = 0; idx < count; idx++)
+	{
+		uint8_t size = fields[idx].size;
+		bool valid;
+		switch (fields[idx].type)
+		{
+		case BLUES_FIELD_STRING:
+			valid = (size != 0);
+			break;
+		case BLUES_FIELD_INT:
+			valid = ((size >= 1) && (size <= 4)) || (size == 8);
+			break;
+		case BLUES_FIELD_UINT:
+			valid = (size >= 1) && (size <= 4);
+			break;
+		case BLUES_FIELD_FLOAT:
+			valid = (size == 2) || (size == 4) || (size == 8);
+			break;
+		default:
+			valid = true;
+			break;
+		}
+		if (!valid)
+		{
+			BLUES_LOG("BLUES", "Invalid template field %s", fields[idx].name);
+			return -1;
+		}
+	}
+
+	blues_template *tpl = &_tpl[_tpl_count];
+	snprintf(tpl->file, sizeof(tpl->file), "%s", file);
+	tpl->fields = fields;
+	tpl->count = count;
+	tpl->payload_len = payload_len;
+	tpl->registered = false;
+	return _tpl_count++;
+}
+
+/**
+ * @brief Send note.template for all templates that were not sent yet
+ * 		Done automatically before the first note.add of a Notefile that is sent with send_req(), send_cmd()
+ * 		or in a batch. Call it before pipelined notes or notes in request slots, these are only checked.
+ * 		The NoteCard keeps the templates, after a reboot of the MCU they are sent once more.
+ *
+ * @return true if all templates are on the NoteCard
+ * @return false if a note.template request failed
+ */
+bool RAK_BLUES::template_apply(void)
+{
+	for (uint8_t idx = 0; idx < _tpl_count; idx++)
+	{
+		if (!template_register(&_tpl[idx]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Check the note.add request in note_json against the template of its Notefile
+ * 		Every body field must be in the template, with the right type and in the range of its size.
+ * 		The binary payload must not be longer than the payload length of the template.
+ * 		Notes for Notefiles without template are always valid.
+ *
+ * @return true if the note matches the template or there is no template
+ * @return false if the note does not match, get_last_err_str() has the field
+ */
+bool RAK_BLUES::template_check(void)
+{
+	blues_template *tpl = template_find();
+	if (tpl == NULL)
+	{
+		return true;
+	}
+
+	if ((_payload_len != 0) && (_payload_len > tpl->payload_len))
+	{
+		snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "template: payload too long");
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+
+	JsonObject body = note_json["body"];
+	if (body.isNull())
+	{
+		return true;
+	}
+	for (JsonPair kv : body)
+	{
+		const char *key = kv.key().c_str();
+		JsonVariant value = kv.value();
+		const blues_template_field *field = NULL;
+		for (uint8_t idx = 0; idx < tpl->count; idx++)
+		{
+			if (strcmp(tpl->fields[idx].name, key) == 0)
+			{
+				field = &tpl->fields[idx];
+				break;
+			}
+		}
+
+		bool valid = false;
+		if (field != NULL)
+		{
+			switch (field->type)
+			{
+			case BLUES_FIELD_STRING:
+				valid = value.is<const char *>() && (strlen(value.as<const char *>()) <= field->size);
+				break;
+			case BLUES_FIELD_INT:
+				if (value.is<long>())
+				{
+					long val = value.as<long>();
+					long max = (field->size >= 4) ? 0x7FFFFFFFL : ((1L << (field->size * 8 - 1)) - 1);
+					valid = (val <= max) && (val >= (-max - 1));
+				}
+				break;
+			case BLUES_FIELD_UINT:
+				if (value.is<unsigned long>())
+				{
+					unsigned long max = (field->size >= 4) ? 0xFFFFFFFFUL : ((1UL << (field->size * 8)) - 1);
+					valid = (value.as<unsigned long>() <= max);
+				}
+				break;
+			case BLUES_FIELD_FLOAT:
+				valid = value.is<float>();
+				if (valid && (field->size == 2))
+				{
+					// Largest half precision value
+					float val = value.as<float>();
+					valid = (val <= 65504.0f) && (val >= -65504.0f);
+				}
+				break;
+			case BLUES_FIELD_BOOL:
+				valid = value.is<bool>();
+				break;
+			}
+		}
+		if (!valid)
+		{
+			snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "template: invalid field %s", key);
+			_last_err = BLUES_ERR_PERMANENT;
+			BLUES_LOG("BLUES", "%s", _last_err_str);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Check a note.add against its template and send the template if it was not sent yet
+ *
+ * @param can_register true if note.template can be sent now, false if the bus is busy with other requests
+ * @return true if the note can be sent
+ * @return false if the note does not match the template
+ */
+bool RAK_BLUES::template_prepare(bool can_register)
+{
+	if (!_is_note || (_tpl_count == 0))
+	{
+		return true;
+	}
+	if (!template_check())
+	{
+		return false;
+	}
+	blues_template *tpl = template_find();
+	if (can_register && (tpl != NULL) && !tpl->registered)
+	{
+		// Without the template the note is still accepted, only less compact
+		template_register(tpl);
+		_last_err = BLUES_ERR_NONE;
+		_last_err_str[0] = 0;
+	}
+	return true;
+}
+
+/**
+ * @brief Find the template for the Notefile of the note.add request in note_json
+ *
+ * @return blues_template* template, NULL if there is none
+ */
+blues_template *RAK_BLUES::template_find(void)
+{
+	const char *file = note_json["file"].as<const char *>();
+	if (file == NULL)
+	{
+		// Default Notefile of note.add
+		file = "data.qo";
+	}
+	for (uint8_t idx = 0; idx < _tpl_count; idx++)
+	{
+		if (strcmp(_tpl[idx].file, file) == 0)
+		{
+			return &_tpl[idx];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Send note.template for a template if it was not sent yet
+ * 		The request is written as text behind the queued batch in in_out_buff, note_json keeps the pending note.
+ *
+ * @param tpl template
+ * @return true if the template is on the NoteCard
+ * @return false if note.template failed
+ */
+bool RAK_BLUES::template_register(blues_template *tpl)
+{
+	if (tpl->registered)
+	{
+		return true;
+	}
+
+	char *buff = (char *)&in_out_buff[_batch_len];
+	size_t size = JSON_BUFF_SIZE - _batch_len;
+	size_t len = snprintf(buff, size, "{\"req\":\"note.template\",\"file\":\"%s\",\"body\":{", tpl->file);
+	for (uint8_t idx = 0; (idx < tpl->count) && (len < size); idx++)
+	{
+		const blues_template_field *field = &tpl->fields[idx];
+		const char *sep = (idx == 0) ? "" : ",";
+		// The NoteCard takes the type and size from the example values
+		switch (field->type)
+		{
+		case BLUES_FIELD_STRING:
+			len += snprintf(&buff[len], size - len, "%s\"%s\":\"%d\"", sep, field->name, field->size);
+			break;
+		case BLUES_FIELD_INT:
+			len += snprintf(&buff[len], size - len, "%s\"%s\":1%d", sep, field->name, field->size);
+			break;
+		case BLUES_FIELD_UINT:
+			len += snprintf(&buff[len], size - len, "%s\"%s\":2%d", sep, field->name, field->size);
+			break;
+		case BLUES_FIELD_FLOAT:
+			len += snprintf(&buff[len], size - len, "%s\"%s\":1%d.1", sep, field->name, field->size);
+			break;
+		case BLUES_FIELD_BOOL:
+			len += snprintf(&buff[len], size - len, "%s\"%s\":true", sep, field->name);
+			break;
+		}
+	}
+	if (len < size)
+	{
+		len += snprintf(&buff[len], size - len, "}");
+	}
+	if ((tpl->payload_len != 0) && (len < size))
+	{
+		len += snprintf(&buff[len], size - len, ",\"length\":%d", tpl->payload_len);
+	}
+	if (len < size)
+	{
+		len += snprintf(&buff[len], size - len, "}\n");
+	}
+	if (len >= size)
+	{
+		BLUES_LOG("BLUES", "Template does not fit into in_out_buff");
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+
+	BLUES_LOG("BLUES", "Send template %s", buff);
+	StaticJsonDocument<BLUES_SLOT_DOC_SIZE> rsp;
+	if (!blues_exchange(rsp, (uint8_t *)buff, len, size, true, NULL, 0))
+	{
+		BLUES_LOG("BLUES", "note.template failed %s", _last_err_str);
+		return false;
+	}
+	tpl->registered = true;
+	return true;
+}
+
+/**
+ * @brief Clear the binary buffer of the NoteCard
+ * 		The binary buffer takes raw data without JSON and Base64 overhead. Fill it with binary_put(),
+ * 		then send it with note.add or web.post and the entry "binary":true.
+ *
+ * @return true if the binary buffer was cleared
+ * @return false if card.binary failed
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   uint8_t image[12000];
+
+   void setup()
+   {
+		// Raw bytes, COBS framed and MD5 checked, in chunks of BLUES_BINARY_CHUNK bytes
+		if (rak_blues.binary_reset() && rak_blues.binary_put(image, sizeof(image)))
+		{
+			rak_blues.start_req((char *)"note.add", false);
+			rak_blues.add_string_entry((char *)"file", (char *)"image.qo");
+			rak_blues.add_bool_entry((char *)"binary", true);
+			rak_blues.send_req();
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::binary_reset(void)
+{
+	start_req((char *)"card.binary");
+	add_bool_entry((char *)"delete", true);
+	if (!send_req())
+	{
+		return false;
+	}
+	_bin_offset = 0;
+	return true;
+}
+
+/**
+ * @brief Get the length of the data in the binary buffer and its max size
+ * 		binary_put() continues at the returned length.
+ *
+ * @param len (out) number of bytes in the binary buffer, can be NULL
+ * @param max (out) max size of the binary buffer, can be NULL
+ * @return true if card.binary succeeded
+ * @return false if card.binary failed
+ */
+bool RAK_BLUES::binary_info(size_t *len, size_t *max)
+{
+	start_req((char *)"card.binary");
+	if (!send_req())
+	{
+		return false;
+	}
+	// "length" is missing if the binary buffer is empty
+	uint32_t value = 0;
+	get_uint32_entry((char *)"length", value);
+	_bin_offset = value;
+	if (len != NULL)
+	{
+		*len = value;
+	}
+	if (max != NULL)
+	{
+		value = 0;
+		get_uint32_entry((char *)"max", value);
+		*max = value;
+	}
+	return true;
+}
+
+/**
+ * @brief Append data to the binary buffer of the NoteCard
+ * 		The data is sent in chunks of BLUES_BINARY_CHUNK bytes with card.binary.put. Each chunk is COBS
+ * 		encoded into in_out_buff behind the request, with the MD5 of the chunk for the check by the NoteCard.
+ * 		Start with binary_reset() or binary_info(), the data is appended at the position known from them.
+ *
+ * @param data bytes to append
+ * @param len number of bytes
+ * @return true if all bytes were stored
+ * @return false if card.binary.put failed, binary_info() returns the stored length
+ */
+bool RAK_BLUES::binary_put(const uint8_t *data, size_t len)
+{
+	while (len != 0)
+	{
+		size_t chunk = (len > BLUES_BINARY_CHUNK) ? BLUES_BINARY_CHUNK : len;
+		char status[BLUES_MD5_HEX_SIZE];
+		blues_md5_hex(status, data, chunk);
+		size_t enc_len = blues_cobs_encoded_len(data, chunk);
+
+		// Not idempotent, a repeated chunk is rejected because of the offset
+		start_req((char *)"card.binary.put", false);
+		add_uint32_entry((char *)"offset", _bin_offset);
+		add_uint32_entry((char *)"cobs", enc_len);
+		add_string_entry((char *)"status", status);
+
+		_last_err = BLUES_ERR_NONE;
+		_last_err_str[0] = 0;
+		size_t jsonLen = serialize_req(in_out_buff, JSON_BUFF_SIZE);
+		// Request, encoded chunk with newline and space for the response
+		if ((jsonLen == 0) || ((jsonLen + enc_len + 1 + 64) > JSON_BUFF_SIZE))
+		{
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		jsonLen += blues_cobs_encode(&in_out_buff[jsonLen], data, chunk, '\n');
+		in_out_buff[jsonLen++] = '\n';
+
+		BLUES_LOG("BLUES", "Binary put %d bytes at %d", chunk, _bin_offset);
+		if (!blues_exchange(note_json, in_out_buff, jsonLen, JSON_BUFF_SIZE, false, NULL, 0))
+		{
+			return false;
+		}
+		_bin_offset += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/**
+ * @brief Read data from the binary buffer of the NoteCard
+ * 		The data is read in chunks of BLUES_BINARY_CHUNK bytes with card.binary.get.
+ * 		The COBS encoded chunk follows the response, it is decoded in in_out_buff and checked with its MD5.
+ *
+ * @param data (out) buffer for the data
+ * @param offset position in the binary buffer
+ * @param len number of bytes to read
+ * @return true if all bytes were read and the checksums match
+ * @return false if card.binary.get failed or a checksum did not match
+ */
+bool RAK_BLUES::binary_get(uint8_t *data, size_t offset, size_t len)
+{
+	while (len != 0)
+	{
+		size_t chunk = (len > BLUES_BINARY_CHUNK) ? BLUES_BINARY_CHUNK : len;
+		start_req((char *)"card.binary.get");
+		add_uint32_entry((char *)"offset", offset);
+		add_uint32_entry((char *)"length", chunk);
+
+		_last_err = BLUES_ERR_NONE;
+		_last_err_str[0] = 0;
+		size_t jsonLen = serialize_req(in_out_buff, JSON_BUFF_SIZE);
+		if (jsonLen == 0)
+		{
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		uint8_t *rsp_buff = &in_out_buff[jsonLen];
+		size_t rsp_size = JSON_BUFF_SIZE - jsonLen;
+
+		bool success = false;
+		for (uint8_t try_send = 0; try_send < _retry_tries; try_send++)
+		{
+			if (try_send != 0)
+			{
+				retry_delay(try_send);
+				BLUES_LOG("BLUES", "Retry %d", try_send);
+			}
+
+			size_t rx_len = 0;
+			if (!blues_transmit(in_out_buff, jsonLen) || !blues_receive(rsp_buff, rsp_size, 1, &rx_len))
+			{
+				if (_last_err == BLUES_ERR_PERMANENT)
+				{
+					break;
+				}
+				_last_err = BLUES_ERR_BUS;
+				blues_resync();
+				continue;
+			}
+
+			// The response line is followed by the encoded chunk, terminated by a newline
+			uint8_t *rsp_end = (uint8_t *)memchr(rsp_buff, '\n', rx_len);
+			if (rsp_end == NULL)
+			{
+				BLUES_LOG("BLUES", "Binary response without newline");
+				_last_err = BLUES_ERR_BUS;
+				blues_resync();
+				return false;
+			}
+			uint8_t *bin = rsp_end + 1;
+			if (!parse_rsp(rsp_buff, NULL, 0))
+			{
+				if ((_last_err == BLUES_ERR_TRANSIENT) || (_last_err == BLUES_ERR_BUS))
+				{
+					continue;
+				}
+				break;
+			}
+			char status[BLUES_MD5_HEX_SIZE];
+			if (!get_string_entry((char *)"status", status, sizeof(status)))
+			{
+				_last_err = BLUES_ERR_PERMANENT;
+				break;
+			}
+
+			uint8_t *bin_end = (uint8_t *)memchr(bin, '\n', &rsp_buff[rx_len] - bin);
+			if (bin_end == NULL)
+			{
+				// The chunk was not complete yet, get the rest
+				size_t more = 0;
+				if (blues_receive(&rsp_buff[rx_len], rsp_size - rx_len, 1, &more))
+				{
+					rx_len += more;
+					bin_end = (uint8_t *)memchr(bin, '\n', &rsp_buff[rx_len] - bin);
+				}
+			}
+			if ((bin_end == NULL) || ((size_t)(bin_end - bin) > BLUES_COBS_ENC_SIZE(chunk)))
+			{
+				_last_err = BLUES_ERR_BUS;
+				blues_resync();
+				continue;
+			}
+
+			// Decode in place, a garbled chunk must not overflow data
+			char check[BLUES_MD5_HEX_SIZE];
+			size_t dec_len = blues_cobs_decode(bin, bin, bin_end - bin, '\n');
+			blues_md5_hex(check, bin, dec_len);
+			if ((dec_len != chunk) || (strcmp(check, status) != 0))
+			{
+				BLUES_LOG("BLUES", "Binary checksum error");
+				_last_err = BLUES_ERR_BUS;
+				continue;
+			}
+			memcpy(data, bin, chunk);
+			success = true;
+			break;
+		}
+		if (!success)
+		{
+			return false;
+		}
+		offset += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/**
+ * @brief Upload a body of any size with web.post or web.put in fragments
+ * 		The body is read with the reader callback in chunks of BLUES_WEB_CHUNK bytes. Each chunk is read into
+ * 		the end of in_out_buff and Base64 encoded into the request in front of it, no other buffer is needed.
+ * 		The fragments are sent with "offset" and "total", each one has the MD5 of its own payload in "status"
+ * 		for the check by the NoteCard. After the last fragment the NoteCard sends the complete body to the route.
+ * 		The NoteCard must be in continuous mode and connected to NoteHub.
+ *
+ * @param route alias of the proxy route in NoteHub
+ * @param name (optional) URL path appended to the route, NULL if not needed
+ * @param total length of the body, must not be 0
+ * @param reader callback that copies len bytes of the body starting at offset into buffer and returns the number of bytes copied
+ * @param progress (optional) called after each fragment with the throughput of the fragment
+ * @param put (optional) true to use web.put instead of web.post, default false
+ * @return true if all fragments were sent and the route returned a 2xx status
+ * @return false if a fragment failed, the reader returned less data or the route returned an error status
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   size_t log_reader(uint8_t *buffer, size_t offset, size_t len)
+   {
+		// Copy the requested part of the log from flash
+		return flash_read(LOG_START + offset, buffer, len);
+   }
+
+   void log_progress(blues_xfer_stats *stats)
+   {
+		Serial.printf("%d/%d bytes, %d bytes/s\n", stats->offset + stats->len, stats->total, stats->bytes_per_s);
+   }
+
+   void setup()
+   {
+		if (!rak_blues.web_post_stream((char *)"logs", (char *)"/upload", LOG_SIZE, log_reader, log_progress))
+		{
+			Serial.printf("Upload failed %s\n", rak_blues.get_last_err_str());
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::web_post_stream(char *route, char *name, size_t total, size_t (*reader)(uint8_t *buffer, size_t offset, size_t len),
+								void (*progress)(blues_xfer_stats *stats), bool put)
+{
+	_last_err = BLUES_ERR_NONE;
+	_last_err_str[0] = 0;
+	if ((total == 0) || (reader == NULL))
+	{
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+
+	blues_md5_ctx md5;
+	blues_xfer_stats stats;
+	stats.total = total;
+
+	size_t offset = 0;
+	while (offset < total)
+	{
+		size_t chunk = ((total - offset) > BLUES_WEB_CHUNK) ? BLUES_WEB_CHUNK : (total - offset);
+		bool last = (offset + chunk) >= total;
+
+		// The raw chunk stays at the end of in_out_buff, the Base64 encoded payload ends in front of it
+		uint8_t *raw = &in_out_buff[JSON_BUFF_SIZE - chunk];
+		if (reader(raw, offset, chunk) != chunk)
+		{
+			snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "reader failed at %d", (int)offset);
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		// The NoteCard checks the payload of each fragment against "status"
+		char status[BLUES_MD5_HEX_SIZE];
+		blues_md5_init(&md5);
+		blues_md5_update(&md5, raw, chunk);
+		blues_md5_final_hex(&md5, status);
+
+		// Fragments can be repeated, the last one makes the NoteCard send the body
+		start_req(put ? (char *)"web.put" : (char *)"web.post", !last);
+		add_string_entry((char *)"route", route);
+		if (name != NULL)
+		{
+			add_string_entry((char *)"name", name);
+		}
+		add_uint32_entry((char *)"offset", offset);
+		add_uint32_entry((char *)"total", total);
+		add_string_entry((char *)"status", status);
+		add_payload_entry(raw, chunk);
+		// The encoded payload must not reach the raw chunk, route and name are not limited otherwise
+		if ((measureJson(note_json) + 16 + BLUES_B64_ENC_SIZE(chunk)) > (JSON_BUFF_SIZE - chunk))
+		{
+			BLUES_LOG("BLUES", "Route and name too long");
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+
+		uint32_t start_ms = millis();
+		if (!send_req())
+		{
+			BLUES_LOG("BLUES", "Fragment at %d failed", offset);
+			return false;
+		}
+
+		stats.offset = offset;
+		stats.len = chunk;
+		stats.ms = millis() - start_ms;
+		stats.bytes_per_s = (stats.ms == 0) ? (uint32_t)(chunk * 1000) : (uint32_t)((uint64_t)chunk * 1000 / stats.ms);
+		BLUES_LOG("BLUES", "Fragment %d bytes at %d in %d ms", chunk, offset, (int)stats.ms);
+		if (progress != NULL)
+		{
+			progress(&stats);
+		}
+		offset += chunk;
+	}
+
+	// HTTP status of the route, in the response to the last fragment
+	int32_t result = 0;
+	if (get_int32_entry((char *)"result", result) && ((result < 200) || (result >= 300)))
+	{
+		snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "http status %d", (int)result);
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Download the host firmware from the NoteCard with dfu.get and stream it into a sink
+ * 		The firmware is read in ranges of BLUES_DOWNLOAD_CHUNK bytes, each range is Base64 decoded in place in
+ * 		in_out_buff and passed to the sink, e.g. a function writing to flash. Nothing else is buffered.
+ * 		offset is updated after each range that was accepted by the sink. After an I2C error the NoteCard is
+ * 		resynchronized and the download resumes at the same range, up to BLUES_DOWNLOAD_RESUMES times per range.
+ * 		If the download fails anyway, save offset and md5_ctx and call it again later to resume.
+ * 		A download resumed without md5_ctx cannot be checked, download_verified() tells if the MD5 was checked.
+ * 		The NoteCard must be in DFU mode, dfu.status shows the length and the MD5 of the firmware.
+ *
+ * @param total length of the firmware
+ * @param sink callback that stores len bytes at offset, returns false to abort the download
+ * @param offset (in/out) position to start at, 0 for a new download, the position of the next range when done
+ * @param md5 (optional) MD5 hex string of the firmware from dfu.status, checked if the download started at 0 or md5_ctx is set
+ * @param progress (optional) called after each range with the throughput of the range
+ * @param md5_ctx (optional) (in/out) MD5 state kept by the caller to check a download resumed in a later call,
+ * 		it is started when offset is 0
+ * @return true if the download is complete
+ * @return false if a range failed, the sink aborted or the MD5 does not match
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   bool flash_sink(const uint8_t *data, size_t offset, size_t len)
+   {
+		// RUI3 flash, WisBlock would write to a file in InternalFS
+		return api.system.flash.set(FW_START + offset, (uint8_t *)data, len);
+   }
+
+   void setup()
+   {
+		// The MD5 state is saved with the offset to check a resumed download
+		blues_md5_ctx md5_ctx;
+		size_t offset = read_saved_offset(&md5_ctx);
+		char md5[BLUES_MD5_HEX_SIZE];
+
+		rak_blues.start_req((char *)"dfu.status");
+		rak_blues.send_req();
+		uint32_t total = 0;
+		rak_blues.get_nested_uint32_entry((char *)"body", (char *)"length", total);
+		rak_blues.get_nested_string_entry((char *)"body", (char *)"md5", md5, sizeof(md5));
+
+		if (!rak_blues.dfu_get_stream(total, flash_sink, &offset, md5, NULL, &md5_ctx))
+		{
+			// Resume after the next wake up
+			save_offset(offset, &md5_ctx);
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::dfu_get_stream(size_t total, bool (*sink)(const uint8_t *data, size_t offset, size_t len), size_t *offset,
+							   const char *md5, void (*progress)(blues_xfer_stats *stats), blues_md5_ctx *md5_ctx)
+{
+	return download_stream((char *)"dfu.get", NULL, NULL, total, sink, offset, md5, progress, md5_ctx);
+}
+
+/**
+ * @brief Check if the last completed download was checked against the MD5
+ * 		A download that was resumed without the MD5 state of the earlier calls is complete but not checked.
+ *
+ * @return true if the MD5 of the complete download matched
+ * @return false if no MD5 was checked
+ */
+bool RAK_BLUES::download_verified(void)
+{
+	return _download_verified;
+}
+
+/**
+ * @brief Download a response body with web.get in ranges and stream it into a sink
+ * 		Same as dfu_get_stream(), the ranges are requested from the route with "offset" and "max".
+ * 		If total is 0, it is taken from "total" in the response, otherwise the download ends with the first range
+ * 		that is shorter than requested.
+ * 		The NoteCard must be in continuous mode and connected to NoteHub.
+ *
+ * @param route alias of the proxy route in NoteHub
+ * @param name (optional) URL path appended to the route, NULL if not needed
+ * @param total length of the body, 0 if unknown
+ * @param sink callback that stores len bytes at offset, returns false to abort the download
+ * @param offset (in/out) position to start at, 0 for a new download, the position of the next range when done
+ * @param progress (optional) called after each range with the throughput of the range
+ * @return true if the download is complete
+ * @return false if a range failed or the sink aborted
+ */
+bool RAK_BLUES::web_get_stream(char *route, char *name, size_t total, bool (*sink)(const uint8_t *data, size_t offset, size_t len), size_t *offset,
+							   void (*progress)(blues_xfer_stats *stats))
+{
+	return download_stream((char *)"web.get", route, name, total, sink, offset, NULL, progress, NULL);
+}
+
+/**
+ * @brief Download in ranges with dfu.get or web.get and pass the decoded ranges to the sink
+ *
+ * @param request dfu.get or web.get
+ * @param route route for web.get, NULL for dfu.get
+ * @param name URL path for web.get, can be NULL
+ * @param total length of the download, 0 if unknown
+ * @param sink callback that stores the decoded range
+ * @param offset (in/out) position of the next range
+ * @param md5 MD5 hex string to check, can be NULL
+ * @param progress callback after each range, can be NULL
+ * @param md5_ctx MD5 state of the caller for resumed downloads, can be NULL
+ * @return true if the download is complete
+ * @return false if a range failed, the sink aborted or the MD5 does not match
+ */
+bool RAK_BLUES::download_stream(char *request, char *route, char *name, size_t total, bool (*sink)(const uint8_t *data, size_t offset, size_t len),
+								size_t *offset, const char *md5, void (*progress)(blues_xfer_stats *stats), blues_md5_ctx *md5_ctx)
+{
+	// The MD5 can only be checked if all data passed here or through the MD5 state of the caller
+	bool check_md5 = (md5 != NULL) && ((*offset == 0) || (md5_ctx != NULL));
+	blues_md5_ctx local_ctx;
+	if (md5_ctx == NULL)
+	{
+		md5_ctx = &local_ctx;
+	}
+	if (*offset == 0)
+	{
+		blues_md5_init(md5_ctx);
+	}
+	_download_verified = false;
+	blues_xfer_stats stats;
+	stats.total = total;
+	uint8_t resumes = 0;
+
+	while ((total == 0) || (*offset < total))
+	{
+		size_t chunk = BLUES_DOWNLOAD_CHUNK;
+		if ((total != 0) && ((total - *offset) < chunk))
+		{
+			chunk = total - *offset;
+		}
+
+		start_req(request);
+		if (route != NULL)
+		{
+			add_string_entry((char *)"route", route);
+			add_uint32_entry((char *)"max", chunk);
+		}
+		else
+		{
+			add_uint32_entry((char *)"length", chunk);
+		}
+		if (name != NULL)
+		{
+			add_string_entry((char *)"name", name);
+		}
+		add_uint32_entry((char *)"offset", *offset);
+
+		uint32_t start_ms = millis();
+		if (!send_req())
+		{
+			// The failed transfer restarted the bus already, resume at the same range
+			if ((_last_err == BLUES_ERR_BUS) && (resumes < BLUES_DOWNLOAD_RESUMES))
+			{
+				resumes++;
+				BLUES_LOG("BLUES", "Resume download at %d", (int)*offset);
+				blues_resync();
+				continue;
+			}
+			return false;
+		}
+		resumes = 0;
+
+		if (route != NULL)
+		{
+			// HTTP status of the route and the body length if the route reports it
+			int32_t result = 0;
+			if (get_int32_entry((char *)"result", result) && ((result < 200) || (result >= 300)))
+			{
+				snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "http status %d", (int)result);
+				_last_err = BLUES_ERR_PERMANENT;
+				return false;
+			}
+			uint32_t body_len = 0;
+			if ((total == 0) && get_uint32_entry((char *)"total", body_len))
+			{
+				total = body_len;
+				stats.total = total;
+			}
+		}
+
+		// Decode in place, the payload string is in in_out_buff
+		const char *payload = note_json["payload"].as<const char *>();
+		size_t dec_len = 0;
+		if ((payload != NULL) && !blues_b64_decode((uint8_t *)payload, strlen(payload), payload, strlen(payload), &dec_len))
+		{
+			snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "invalid payload at %d", (int)*offset);
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		if ((dec_len != 0) && !sink((const uint8_t *)payload, *offset, dec_len))
+		{
+			snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "sink failed at %d", (int)*offset);
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		if (check_md5)
+		{
+			blues_md5_update(md5_ctx, (const uint8_t *)payload, dec_len);
+		}
+
+		stats.offset = *offset;
+		stats.len = dec_len;
+		stats.ms = millis() - start_ms;
+		stats.bytes_per_s = (stats.ms == 0) ? (uint32_t)(dec_len * 1000) : (uint32_t)((uint64_t)dec_len * 1000 / stats.ms);
+		*offset += dec_len;
+		if (progress != NULL)
+		{
+			progress(&stats);
+		}
+
+		// A short range is the end of a download with unknown length
+		if (dec_len < chunk)
+		{
+			if (total == 0)
+			{
+				break;
+			}
+			if (dec_len == 0)
+			{
+				snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "no data at %d", (int)*offset);
+				_last_err = BLUES_ERR_PERMANENT;
+				return false;
+			}
+		}
+	}
+
+	if (check_md5)
+	{
+		char check[BLUES_MD5_HEX_SIZE];
+		blues_md5_final_hex(md5_ctx, check);
+		if (strcmp(check, md5) != 0)
+		{
+			snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "md5 mismatch");
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		_download_verified = true;
+	}
+	return true;
+}
+
+/**
+ * @brief Default invalidating requests of card.* requests, there is no card.set
+ *
+ */
+static const struct
+{
+	const char *req;
+	const char *inval;
+} blues_cache_inval[] = {
+	{"card.version", ""},
+	{"card.wireless", "card.wireless"},
+	{"card.location", "card.location.mode"},
+};
+
+/**
+ * @brief Get the default invalidating request of a cached request
+ *
+ * @param request name of the request
+ * @param inval (out) invalidating request
+ * @param size size of inval
+ * @return true if the request has a default
+ * @return false if a card.* request is not in the table
+ */
+static bool cache_default_inval(const char *request, char *inval, size_t size)
+{
+	for (size_t idx = 0; idx < sizeof(blues_cache_inval) / sizeof(blues_cache_inval[0]); idx++)
+	{
+		if (strcmp(blues_cache_inval[idx].req, request) == 0)
+		{
+			snprintf(inval, size, "%s", blues_cache_inval[idx].inval);
+			return true;
+		}
+	}
+	if (strncmp(request, "card.", 5) == 0)
+	{
+		return false;
+	}
+	// hub.get is changed by hub.set
+	const char *dot = strchr(request, '.');
+	int module_len = (dot == NULL) ? strlen(request) : (dot - request);
+	snprintf(inval, size, "%.*s.set", module_len, request);
+	return true;
+}
+
+/**
+ * @brief Set the storage of the response cache
+ * 		The application supplies the entries for the cached responses, each entry needs about
+ * 		BLUES_CACHE_RSP_SIZE bytes. Without cache_begin() no RAM is used for the cache and cache_add() fails.
+ * 		All cached responses are dropped, the cached requests are kept.
+ *
+ * @param entries array of cache entries, must stay valid while the cache is used
+ * @param count number of entries, e.g. one per cached request
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // RAM for the cached responses
+   blues_cache_entry cache_entries[BLUES_CACHE_ENTRIES];
+
+   void setup()
+   {
+		rak_blues.cache_begin(cache_entries, BLUES_CACHE_ENTRIES);
+		rak_blues.cache_add((char *)"hub.status", 10);
+   }
+ * @endcode
+ */
+void RAK_BLUES::cache_begin(blues_cache_entry *entries, uint8_t count)
+{
+	_cache_entries = entries;
+	_cache_entry_count = (entries != NULL) ? count : 0;
+	for (uint8_t idx = 0; idx < _cache_entry_count; idx++)
+	{
+		_cache_entries[idx].valid = false;
+	}
+}
+
+/**
+ * @brief Cache the responses of a read-mostly request in RAM
+ * 		Responses of send_req() for the request are kept for ttl_s seconds, keyed by the request name
+ * 		and its arguments. A repeated request with the same arguments is answered from RAM without I2C transfer,
+ * 		the response is in note_json as usual. The cached responses are dropped when the invalidating request
+ * 		is sent, with send_req(), send_cmd(), in a batch, pipelined or with the request slots.
+ * 		A cached hub.status is also dropped when sync_process() starts a sync.
+ * 		The responses are kept in the entries set with cache_begin(), if all are in use the oldest one is replaced.
+ * 		Responses longer than BLUES_CACHE_RSP_SIZE are not cached.
+ *
+ * @param request name of the request, e.g. hub.status
+ * @param ttl_s time a response is valid in seconds, 0 to keep it until it is invalidated
+ * @param invalidated_by (optional) request that changes the response, NULL (default) for the .set request of the same module,
+ * 			e.g. hub.set for hub.get. There is no card.set, card.version, card.wireless and card.location have their own
+ * 			defaults, other card.* requests need it. Use the request name itself if the same request can change settings,
+ * 			or "" if no request changes the response
+ * @return true if the request is cached
+ * @return false if cache_begin() was not called, all BLUES_CACHE_RULES are in use or a card.* request has no invalidating request
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // RAM for the cached responses
+   blues_cache_entry cache_entries[BLUES_CACHE_ENTRIES];
+
+   void setup()
+   {
+		rak_blues.cache_begin(cache_entries, BLUES_CACHE_ENTRIES);
+		// The version does not change, the connection status is good enough for 10 seconds
+		rak_blues.cache_add((char *)"card.version", 0);
+		rak_blues.cache_add((char *)"hub.status", 10);
+		rak_blues.cache_add((char *)"card.temp", 60, (char *)"");
+   }
+
+   void loop()
+   {
+		// Only the first request goes to the NoteCard
+		for (int idx = 0; idx < 5; idx++)
+		{
+			rak_blues.start_req((char *)"card.version");
+			rak_blues.send_req();
+		}
+		delay(60000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::cache_add(char *request, uint32_t ttl_s, char *invalidated_by)
+{
+	if (_cache_entry_count == 0)
+	{
+		BLUES_LOG("BLUES", "No cache entries, call cache_begin()");
+		return false;
+	}
+
+	char inval[sizeof(_cache_rules[0].inval)];
+	if (invalidated_by != NULL)
+	{
+		snprintf(inval, sizeof(inval), "%s", invalidated_by);
+	}
+	else if (!cache_default_inval(request, inval, sizeof(inval)))
+	{
+		BLUES_LOG("BLUES", "%s needs an invalidating request", request);
+		return false;
+	}
+
+	int8_t rule = cache_rule_find(request);
+	if (rule < 0)
+	{
+		if (_cache_rule_count >= BLUES_CACHE_RULES)
+		{
+			BLUES_LOG("BLUES", "Cache rules are full");
+			return false;
+		}
+		rule = _cache_rule_count++;
+	}
+	else
+	{
+		cache_invalidate(request);
+	}
+
+	blues_cache_rule *cache_rule = &_cache_rules[rule];
+	snprintf(cache_rule->req, sizeof(cache_rule->req), "%s", request);
+	memcpy(cache_rule->inval, inval, sizeof(cache_rule->inval));
+	cache_rule->ttl_ms = ttl_s * 1000;
+	return true;
+}
+
+/**
+ * @brief Drop cached responses
+ *
+ * @param request (optional) name of the request, NULL (default) to drop all cached responses
+ */
+void RAK_BLUES::cache_invalidate(char *request)
+{
+	for (uint8_t idx = 0; idx < _cache_entry_count; idx++)
+	{
+		if (_cache_entries[idx].valid && ((request == NULL) || (strcmp(_cache_rules[_cache_entries[idx].rule].req, request) == 0)))
+		{
+			_cache_entries[idx].valid = false;
+		}
+	}
+}
+
+/**
+ * @brief Send the request in note_json or answer it from the cache
+ *
+ * @param response if not NULL, the response of the Notecard will copied into this buffer
+ * @param resp_len max length of buffer for the Notecard response
+ * @return true if the response came from the cache or the request could be sent and the response does not have "err"
+ * @return false if request could not be sent or the response did have "err"
+ */
+bool RAK_BLUES::cache_request(char *response, uint16_t resp_len)
+{
+	_last_err = BLUES_ERR_NONE;
+	_last_err_str[0] = 0;
+
+	size_t jsonLen = serialize_req(in_out_buff, JSON_BUFF_SIZE);
+	if (jsonLen == 0)
+	{
+		_last_err = BLUES_ERR_PERMANENT;
+		return false;
+	}
+
+	int8_t rule = cache_rule_find(note_json["req"].as<const char *>());
+	uint32_t key = 0;
+	if (rule >= 0)
+	{
+		key = blues_hash(in_out_buff, jsonLen);
+		for (uint8_t idx = 0; idx < _cache_entry_count; idx++)
+		{
+			blues_cache_entry *entry = &_cache_entries[idx];
+			if (!entry->valid || (entry->rule != rule) || (entry->key != key))
+			{
+				continue;
+			}
+			uint32_t ttl_ms = _cache_rules[rule].ttl_ms;
+			if ((ttl_ms != 0) && ((uint32_t)(millis() - entry->ms) >= ttl_ms))
+			{
+				entry->valid = false;
+				break;
+			}
+			// Parse a copy, the strings of note_json stay in in_out_buff
+			memcpy(in_out_buff, entry->rsp, entry->len + 1);
+			BLUES_LOG("BLUES", "Cached response %s", entry->rsp);
+			return parse_rsp(in_out_buff, response, resp_len);
+		}
+	}
+
+	cache_sent();
+	if (!blues_exchange(note_json, in_out_buff, jsonLen, JSON_BUFF_SIZE, _idempotent, response, resp_len))
+	{
+		return false;
+	}
+	if (rule >= 0)
+	{
+		cache_store(rule, key);
+	}
+	return true;
+}
+
+/**
+ * @brief Drop the cached responses that are changed by the request in note_json
+ *
+ */
+void RAK_BLUES::cache_sent(void)
+{
+	if (_cache_rule_count == 0)
+	{
+		return;
+	}
+	const char *request = note_json.containsKey("req") ? note_json["req"].as<const char *>() : note_json["cmd"].as<const char *>();
+	if (request == NULL)
+	{
+		return;
+	}
+	for (uint8_t rule = 0; rule < _cache_rule_count; rule++)
+	{
+		if (strcmp(_cache_rules[rule].inval, request) != 0)
+		{
+			continue;
+		}
+		for (uint8_t idx = 0; idx < _cache_entry_count; idx++)
+		{
+			if (_cache_entries[idx].rule == rule)
+			{
+				_cache_entries[idx].valid = false;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Store the response in note_json in the cache
+ * 		A free entry is used, or the oldest one is replaced.
+ *
+ * @param rule index of the cache rule
+ * @param key hash of the serialized request
+ */
+void RAK_BLUES::cache_store(uint8_t rule, uint32_t key)
+{
+	if (_cache_entry_count == 0)
+	{
+		return;
+	}
+	size_t len = measureJson(note_json);
+	if (len >= BLUES_CACHE_RSP_SIZE)
+	{
+		BLUES_LOG("BLUES", "Response too large for the cache");
+		return;
+	}
+
+	uint32_t now = millis();
+	blues_cache_entry *entry = &_cache_entries[0];
+	for (uint8_t idx = 0; idx < _cache_entry_count; idx++)
+	{
+		if (!_cache_entries[idx].valid)
+		{
+			entry = &_cache_entries[idx];
+			break;
+		}
+		if ((uint32_t)(now - _cache_entries[idx].ms) > (uint32_t)(now - entry->ms))
+		{
+			entry = &_cache_entries[idx];
+		}
+	}
+	entry->len = serializeJson(note_json, entry->rsp, BLUES_CACHE_RSP_SIZE);
+	entry->key = key;
+	entry->rule = rule;
+	entry->ms = now;
+	entry->valid = true;
+}
+
+/**
+ * @brief Find the cache rule of a request
+ *
+ * @param request name of the request
+ * @return int8_t index of the cache rule, -1 if the request is not cached
+ */
+int8_t RAK_BLUES::cache_rule_find(const char *request)
+{
+	if (request == NULL)
+	{
+		return -1;
+	}
+	for (uint8_t rule = 0; rule < _cache_rule_count; rule++)
+	{
+		if (strcmp(_cache_rules[rule].req, request) == 0)
+		{
+			return rule;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Start the local clock
+ * 		The clock is set from card.time and then runs on millis(). Each later card.time sync measures how far
+ * 		millis() drifted from the NoteCard time and time_now() corrects the drift between the syncs.
+ * 		Without a valid time, e.g. before the NoteCard connected to NoteHub, time_process() tries again.
+ *
+ * @param resync_s (optional) interval to get card.time again in seconds, default 86400
+ * @param stamp_samples (optional) true to add "time" to the body of samples in sample_add(), default false
+ * @return true if the clock was set
+ * @return false if card.time failed or the NoteCard has no time yet
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // RAM for the samples waiting for a flush
+   uint8_t sample_buff[BLUES_SAMPLE_BUFF_SIZE];
+
+   void setup()
+   {
+		// Resync every 6 hours, samples get their own time
+		rak_blues.time_begin(21600, true);
+		rak_blues.sample_begin((char *)"data.qo", sample_buff, sizeof(sample_buff));
+   }
+
+   void loop()
+   {
+		rak_blues.time_process();
+		// The body gets "time" without a card.time request
+		rak_blues.start_req((char *)"note.add", false);
+		rak_blues.add_nested_float_entry((char *)"body", (char *)"temp", read_temperature());
+		rak_blues.sample_add();
+		delay(60000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::time_begin(uint32_t resync_s, bool stamp_samples)
+{
+	_time_resync_ms = resync_s * 1000;
+	_time_stamp_samples = stamp_samples;
+	_time_valid = false;
+	_time_drift_ppm = 0;
+	_time_drift_known = false;
+	return time_sync();
+}
+
+/**
+ * @brief Get card.time and update the clock and the drift of millis()
+ *
+ * @return true if the clock was set
+ * @return false if card.time failed or the NoteCard has no time yet
+ */
+bool RAK_BLUES::time_sync(void)
+{
+	_time_try_ms = millis();
+	uint32_t start_ms = millis();
+	if (!start_req((char *)"card.time") || !send_req())
+	{
+		return false;
+	}
+	uint32_t card_time = 0;
+	if (!get_uint32_entry((char *)"time", card_time) || (card_time == 0))
+	{
+		// Older firmware responds without "time" instead of {no-time}
+		_last_err = BLUES_ERR_TRANSIENT;
+		return false;
+	}
+	// The NoteCard read the time about in the middle of the round trip
+	uint32_t now_ms = start_ms + (millis() - start_ms) / 2;
+
+	if (_time_valid)
+	{
+		// The time has 1 second resolution, keep the old base to measure the drift over a long interval
+		uint32_t elapsed_ms = now_ms - _time_base_ms;
+		if (elapsed_ms < 3600000UL)
+		{
+			return true;
+		}
+		int64_t error_ms = (int64_t)(int32_t)(card_time - _time_base_s) * 1000 - elapsed_ms;
+		int32_t drift_ppm = (int32_t)(error_ms * 1000000 / elapsed_ms);
+		_time_drift_ppm = _time_drift_known ? (3 * _time_drift_ppm + drift_ppm) / 4 : drift_ppm;
+		_time_drift_known = true;
+		BLUES_LOG("BLUES", "Clock error %d ms, drift %d ppm", (int)error_ms, (int)_time_drift_ppm);
+	}
+	_time_base_s = card_time;
+	_time_base_ms = now_ms;
+	_time_valid = true;
+	return true;
+}
+
+/**
+ * @brief Resync the clock if the resync interval passed or the clock is not set yet
+ * 		Call it from the loop or a timer. It does not access the NoteCard unless a resync is due,
+ * 		without a valid time it tries once a minute.
+ *
+ * @return true if card.time was requested and the clock was set
+ * @return false if no resync was due or it failed
+ */
+bool RAK_BLUES::time_process(void)
+{
+	uint32_t now = millis();
+	if (_time_valid)
+	{
+		if ((_time_resync_ms == 0) || ((uint32_t)(now - _time_try_ms) < _time_resync_ms))
+		{
+			return false;
+		}
+	}
+	else if ((uint32_t)(now - _time_try_ms) < 60000)
+	{
+		return false;
+	}
+	return time_sync();
+}
+
+/**
+ * @brief Get the current time from the local clock without a request to the NoteCard
+ *
+ * @return uint32_t UTC time in seconds since 1970, 0 if the clock is not set
+ */
+uint32_t RAK_BLUES::time_now(void)
+{
+	if (!_time_valid)
+	{
+		return 0;
+	}
+	uint32_t elapsed_ms = millis() - _time_base_ms;
+	int64_t corrected_ms = (int64_t)elapsed_ms + (int64_t)elapsed_ms * _time_drift_ppm / 1000000;
+	return _time_base_s + (uint32_t)(corrected_ms / 1000);
+}
+
+/**
+ * @brief Check if the local clock is set
+ *
+ * @return true if the clock was set from card.time
+ * @return false if the clock is not set
+ */
+bool RAK_BLUES::time_valid(void)
+{
+	return _time_valid;
+}
+
+/**
+ * @brief Get the measured drift of millis() against the NoteCard time
+ *
+ * @return int32_t drift in ppm, positive if millis() is slow, 0 until measured by a resync
+ */
+int32_t RAK_BLUES::time_drift_ppm(void)
+{
+	return _time_drift_ppm;
+}
+
+/**
+ * @brief Start the location service
+ * 		The service keeps the last fix of the NoteCard in RAM. location_get() answers from this cache as long as the
+ * 		fix is younger than max_age_s. Only if the fix is too old, card.location is requested and if the NoteCard
+ * 		has no newer fix, GNSS is switched on. When the new fix arrives, GNSS is switched off again.
+ * 		Arm ATTN with BLUES_ATTN_LOCATION and call location_update() on the event, or call location_get() again later.
+ * 		The age of a fix is calculated from its time with the clock of time_begin(). Without the clock only a fix
+ * 		found while GNSS was switched on by the service is known as fresh.
+ * 		The GNSS mode is read from the NoteCard. If GNSS is still on, e.g. after a reboot while it was searching,
+ * 		the service takes it over and switches it off after the next fresh fix.
+ *
+ * @param max_age_s max age of a fix in seconds that is returned from the cache
+ * @param gnss_s (optional) GNSS sampling interval while the service waits for a fix in seconds, 0 (default) for continuous mode
+ * @return true if the GNSS mode was read from the NoteCard
+ * @return false if card.location.mode failed, the GNSS state is unknown
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void attn_cb(void)
+   {
+		api_wake_loop(BLUES_ATTN);
+   }
+
+   void setup()
+   {
+		rak_blues.time_begin();
+		// A fix is good for 1 hour
+		rak_blues.location_begin(3600);
+		rak_blues.attn_begin(WB_IO5, attn_cb);
+		rak_blues.attn_arm(BLUES_ATTN_LOCATION);
+   }
+
+   void loop()
+   {
+		blues_location location;
+		if (rak_blues.location_get(&location))
+		{
+			Serial.printf("%.6f %.6f, %ds old\n", location.lat, location.lon, location.age_s);
+		}
+		if (rak_blues.attn_pending())
+		{
+			// GNSS is switched off after the new fix
+			rak_blues.location_update();
+			rak_blues.attn_arm(BLUES_ATTN_LOCATION);
+		}
+		delay(60000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::location_begin(uint32_t max_age_s, uint32_t gnss_s)
+{
+	_loc_max_age_ms = max_age_s * 1000;
+	_loc_gnss_s = gnss_s;
+
+	// The MCU might have restarted while the service had GNSS switched on
+	if (!start_req((char *)"card.location.mode") || !send_req())
+	{
+		return false;
+	}
+	const char *mode = note_json["mode"].as<const char *>();
+	_loc_gnss_on = (mode != NULL) && (mode[0] != 0) && (strcmp(mode, "off") != 0);
+	if (_loc_gnss_on)
+	{
+		BLUES_LOG("BLUES", "GNSS is on (%s), switched off after the next fix", mode);
+		location_update();
+	}
+	return true;
+}
+
+/**
+ * @brief Get the location, from the cache if the fix is not too old
+ * 		Does not access the NoteCard while the cached fix is fresh. Otherwise card.location is requested
+ * 		and GNSS is switched on if the NoteCard has no fresh fix.
+ *
+ * @param location (out) last known fix, age_s is its age, valid is false if no fix is known. Can be NULL
+ * @return true if the fix is younger than the max age
+ * @return false if no fresh fix is known, GNSS is searching
+ */
+bool RAK_BLUES::location_get(blues_location *location)
+{
+	if (!location_fresh())
+	{
+		// The NoteCard might have a newer fix already
+		location_update();
+	}
+	bool fresh = location_fresh();
+	if (!fresh && !_loc_gnss_on)
+	{
+		location_gnss(true);
+	}
+	if (location != NULL)
+	{
+		*location = _loc;
+		location->age_s = location_age();
+	}
+	return fresh;
+}
+
+/**
+ * @brief Read the fix of the NoteCard with card.location into the cache
+ * 		Call it after an ATTN location event. If GNSS was switched on by the service and the fix is fresh,
+ * 		GNSS is switched off.
+ *
+ * @return true if the NoteCard has a fix
+ * @return false if card.location failed or there is no fix
+ */
+bool RAK_BLUES::location_update(void)
+{
+	if (!start_req((char *)"card.location") || !send_req())
+	{
+		return false;
+	}
+	if (!has_entry((char *)"lat") || !has_entry((char *)"lon"))
+	{
+		return false;
+	}
+	uint32_t fix_time = 0;
+	get_uint32_entry((char *)"time", fix_time);
+
+	// The same fix again, keep its age
+	if (!_loc.valid || (fix_time == 0) || (fix_time != _loc.time))
+	{
+		uint32_t now_ms = millis();
+		if ((fix_time != 0) && time_valid())
+		{
+			uint32_t now_s = time_now();
+			_loc_ms = now_ms - ((now_s > fix_time) ? (now_s - fix_time) * 1000 : 0);
+		}
+		else if (_loc_gnss_on && (fix_time != _loc.time))
+		{
+			// New fix while GNSS was switched on by the service
+			_loc_ms = now_ms;
+		}
+		else
+		{
+			// Unknown age, handled as too old
+			_loc_ms = now_ms - _loc_max_age_ms;
+		}
+		_loc.lat = note_json["lat"].as<double>();
+		_loc.lon = note_json["lon"].as<double>();
+		_loc.dop = note_json["dop"].as<float>();
+		_loc.time = fix_time;
+		_loc.valid = true;
+		BLUES_LOG("BLUES", "Fix %.6f %.6f, %ds old", _loc.lat, _loc.lon, (int)location_age());
+	}
+
+	if (_loc_gnss_on && location_fresh())
+	{
+		location_gnss(false);
+	}
+	return true;
+}
+
+/**
+ * @brief Get the age of the cached fix
+ *
+ * @return uint32_t age in seconds, UINT32_MAX if no fix is known
+ */
+uint32_t RAK_BLUES::location_age(void)
+{
+	if (!_loc.valid)
+	{
+		return UINT32_MAX;
+	}
+	return (uint32_t)(millis() - _loc_ms) / 1000;
+}
+
+/**
+ * @brief Check if the cached fix is younger than the max age
+ *
+ * @return true if the fix is fresh
+ * @return false if no fix is known or it is too old
+ */
+bool RAK_BLUES::location_fresh(void)
+{
+	return _loc.valid && ((uint32_t)(millis() - _loc_ms) < _loc_max_age_ms);
+}
+
+/**
+ * @brief Switch GNSS of the NoteCard on or off with card.location.mode
+ *
+ * @param on true to switch GNSS on in continuous or periodic mode, false to switch it off
+ * @return true if the mode was set
+ * @return false if card.location.mode failed
+ */
+bool RAK_BLUES::location_gnss(bool on)
+{
+	start_req((char *)"card.location.mode");
+	if (!on)
+	{
+		add_string_entry((char *)"mode", (char *)"off");
+	}
+	else if (_loc_gnss_s == 0)
+	{
+		add_string_entry((char *)"mode", (char *)"continuous");
+	}
+	else
+	{
+		add_string_entry((char *)"mode", (char *)"periodic");
+		add_uint32_entry((char *)"seconds", _loc_gnss_s);
+	}
+	if (!send_req())
+	{
+		return false;
+	}
+	BLUES_LOG("BLUES", "GNSS %s", on ? "on" : "off");
+	_loc_gnss_on = on;
+	return true;
+}
+
+/**
+ * @brief Check if the NoteCard is on the bus, without a JSON request
+ * 		Without available, only the I2C address is sent. The NoteCard answers with an ACK, no data is prepared,
+ * 		this takes less than 100 us at 400 kHz. With available, the zero byte read query of the NoteCard
+ * 		returns the number of bytes it has pending, including the 2 ms the NoteCard needs to prepare the answer.
+ * 		There is no retry and no bus restart, a failed ping only means the NoteCard did not answer now.
+ * 		The result is kept for ping_cached().
+ *
+ * @param available (optional) (out) number of bytes the NoteCard has pending, NULL (default) for the address check only
+ * @return true if the NoteCard answered
+ * @return false if the NoteCard did not answer
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void setup()
+   {
+		Wire.begin();
+		if (!rak_blues.ping())
+		{
+			Serial.println("No NoteCard found");
+		}
+   }
+
+   void loop()
+   {
+		// On the hot path, only checks the bus if the last result is older than 5 seconds
+		if (rak_blues.ping_cached(5000))
+		{
+			send_data();
+		}
+		delay(1000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::ping(uint32_t *available)
+{
+	Wire.beginTransmission(static_cast<uint8_t>(_deviceAddress));
+	if (available != NULL)
+	{
+		// Zero byte read query, same as blues_I2C_RX() without data
+		Wire.write(static_cast<uint8_t>(0));
+		Wire.write(static_cast<uint8_t>(0));
+	}
+	bool present = (Wire.endTransmission() == 0);
+
+	if (present && (available != NULL))
+	{
+		::delay(2);
+		present = (Wire.requestFrom((int)_deviceAddress, 2) == 2);
+		if (present)
+		{
+			uint32_t pending = Wire.read();
+			// Number of bytes in this answer, 0 for the query
+			uint8_t count = Wire.read();
+			// A floating bus reads 0xFF for both bytes, same limit as in blues_I2C_RX()
+			present = (count == 0) && (pending <= (255 - 2));
+			if (present)
+			{
+				*available = pending;
+			}
+			else
+			{
+				BLUES_LOG("BLUES_I2C", "Ping invalid answer %d %d", (int)pending, (int)count);
+			}
+		}
+	}
+
+	_ping_ok = present;
+	_ping_ms = millis();
+	return present;
+}
+
+/**
+ * @brief Get the last presence check result, ping the NoteCard only if it is too old
+ * 		Successful requests count as a presence check as well. On a hot path this is only a time comparison.
+ *
+ * @param max_age_ms (optional) max age of the last result, default 1000 ms
+ * @return true if the NoteCard answered the last check
+ * @return false if the NoteCard did not answer
+ */
+bool RAK_BLUES::ping_cached(uint32_t max_age_ms)
+{
+	if ((_ping_ms == 0) || ((uint32_t)(millis() - _ping_ms) >= max_age_ms))
+	{
+		return ping();
+	}
+	return _ping_ok;
+}
+
+#if BLUES_USE_RTOS > 0
+/**
+ * @brief Start the worker task that owns the NoteCard
+ * 		Tasks submit requests with worker_submit() into a queue, the worker task sends them one by one.
+ * 		The callers do not use note_json and in_out_buff and do not wait for the I2C transfer.
+ * 		Tasks that use start_req() and send_req() directly must call worker_lock() before and worker_unlock() after.
+ *
+ * @param queue_len (optional) max number of waiting requests, default BLUES_WORKER_QUEUE
+ * @param priority (optional) FreeRTOS priority of the worker task, default 1
+ * @return true if the worker task was started
+ * @return false if the queue, mutex or task could not be created
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void status_cb(JsonDocument &rsp, bool success)
+   {
+		// Runs in the worker task
+		if (success)
+		{
+			Serial.printf("Connected: %s\n", rsp["connected"].as<bool>() ? "yes" : "no");
+		}
+   }
+
+   void sensor_task(void *param)
+   {
+		StaticJsonDocument<128> note;
+		while (true)
+		{
+			note.clear();
+			note["req"] = "note.add";
+			note["body"]["temp"] = read_temperature();
+			// Returns immediately, the worker sends the note
+			rak_blues.worker_submit(note);
+			delay(60000);
+		}
+   }
+
+   void setup()
+   {
+		rak_blues.worker_begin();
+		xTaskCreate(sensor_task, "SENS", 1024, NULL, 1, NULL);
+   }
+
+   void loop()
+   {
+		rak_blues.worker_submit("{\"req\":\"hub.status\"}", status_cb);
+		delay(10000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::worker_begin(uint8_t queue_len, uint8_t priority)
+{
+	if (_worker_queue != NULL)
+	{
+		return true;
+	}
+	_worker_mutex = xSemaphoreCreateMutex();
+	_worker_queue = xQueueCreate(queue_len, sizeof(blues_worker_req));
+	if ((_worker_mutex == NULL) || (_worker_queue == NULL))
+	{
+		BLUES_LOG("BLUES", "Worker queue failed");
+		return false;
+	}
+	if (xTaskCreate(worker_task, "BLUES", BLUES_WORKER_STACK / sizeof(StackType_t), this, priority, NULL) != pdPASS)
+	{
+		BLUES_LOG("BLUES", "Worker task failed");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Queue a request for the worker task
+ * 		The request is copied into the queue, the function returns without waiting.
+ * 		The worker sends it with send_req(), or send_cmd() if it has "cmd" instead of "req".
+ * 		note.add is sent as not idempotent, all other requests are repeated on errors.
+ *
+ * @param request request as JSON text, max BLUES_WORKER_REQ_SIZE - 1 characters
+ * @param callback (optional) called by the worker task with the response, NULL (default) if not needed
+ * @param done (optional) semaphore given by the worker task when the request is finished, NULL (default) if not needed
+ * @param success (optional) (out) result of the request, set before done is given, NULL (default) if not needed
+ * @return true if the request is queued
+ * @return false if the queue is full, the request is too long or the worker is not started
+ */
+bool RAK_BLUES::worker_submit(const char *request, void (*callback)(JsonDocument &rsp, bool success), SemaphoreHandle_t done, bool *success)
+{
+	blues_worker_req item;
+	if (_worker_queue == NULL)
+	{
+		return false;
+	}
+	size_t len = strlen(request);
+	if (len >= BLUES_WORKER_REQ_SIZE)
+	{
+		BLUES_LOG("BLUES", "Worker request too long, %d bytes", (int)len);
+		return false;
+	}
+	memcpy(item.req, request, len + 1);
+	item.callback = callback;
+	item.done = done;
+	item.success = success;
+	return xQueueSend(_worker_queue, &item, 0) == pdTRUE;
+}
+
+/**
+ * @brief Queue a request for the worker task, built in a JSON document of the caller
+ *
+ * @param request JSON document of the caller with the request
+ * @param callback (optional) called by the worker task with the response, NULL (default) if not needed
+ * @param done (optional) semaphore given by the worker task when the request is finished, NULL (default) if not needed
+ * @param success (optional) (out) result of the request, set before done is given, NULL (default) if not needed
+ * @return true if the request is queued
+ * @return false if the queue is full, the request is too long or the worker is not started
+ */
+bool RAK_BLUES::worker_submit(JsonDocument &request, void (*callback)(JsonDocument &rsp, bool success), SemaphoreHandle_t done, bool *success)
+{
+	blues_worker_req item;
+	if (_worker_queue == NULL)
+	{
+		return false;
+	}
+	// Checked before, serializeJson() would truncate silently
+	size_t len = measureJson(request);
+	if (len >= BLUES_WORKER_REQ_SIZE)
+	{
+		BLUES_LOG("BLUES", "Worker request too long, %d bytes", (int)len);
+		return false;
+	}
+	serializeJson(request, item.req, BLUES_WORKER_REQ_SIZE);
+	item.callback = callback;
+	item.done = done;
+	item.success = success;
+	return xQueueSend(_worker_queue, &item, 0) == pdTRUE;
+}
+
+/**
+ * @brief Get exclusive access to the NoteCard for direct requests
+ * 		Without a started worker, it always succeeds.
+ *
+ * @param wait_ms (optional) max time to wait for the worker to finish its request, default forever
+ * @return true if the NoteCard can be used
+ * @return false if the worker did not finish in time
+ */
+bool RAK_BLUES::worker_lock(uint32_t wait_ms)
+{
+	if (_worker_mutex == NULL)
+	{
+		return true;
+	}
+	return xSemaphoreTake(_worker_mutex, (wait_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms)) == pdTRUE;
+}
+
+/**
+ * @brief Release the NoteCard after direct requests
+ *
+ */
+void RAK_BLUES::worker_unlock(void)
+{
+	if (_worker_mutex != NULL)
+	{
+		xSemaphoreGive(_worker_mutex);
+	}
+}
+
+/**
+ * @brief Get the number of requests waiting for the worker task
+ *
+ * @return uint8_t number of queued requests
+ */
+uint8_t RAK_BLUES::worker_pending(void)
+{
+	if (_worker_queue == NULL)
+	{
+		return 0;
+	}
+	return (uint8_t)uxQueueMessagesWaiting(_worker_queue);
+}
+
+/**
+ * @brief FreeRTOS task function of the worker
+ *
+ * @param param RAK_BLUES instance
+ */
+void RAK_BLUES::worker_task(void *param)
+{
+	RAK_BLUES *blues = (RAK_BLUES *)param;
+	blues_worker_req item;
+	while (true)
+	{
+		if (xQueueReceive(blues->_worker_queue, &item, portMAX_DELAY) == pdTRUE)
+		{
+			blues->worker_process(&item);
+		}
+	}
+}
+
+/**
+ * @brief Send one queued request, the NoteCard is locked while it is sent
+ *
+ * @param item queued request
+ */
+void RAK_BLUES::worker_process(blues_worker_req *item)
+{
+	xSemaphoreTake(_worker_mutex, portMAX_DELAY);
+
+	bool success = false;
+	note_json.clear();
+	// Copies the strings, item is only a local copy of the queue entry
+	if (!deserializeJson(note_json, (const char *)item->req))
+	{
+		_is_cmd = note_json.containsKey("cmd");
+		const char *request = _is_cmd ? note_json["cmd"].as<const char *>() : note_json["req"].as<const char *>();
+		_is_note = (request != NULL) && (strcmp(request, "note.add") == 0);
+		_idempotent = !_is_note || _is_cmd;
+		_payload = NULL;
+		_payload_len = 0;
+		success = _is_cmd ? send_cmd() : send_req();
+	}
+	else
+	{
+		BLUES_LOG("BLUES", "Invalid worker request %s", item->req);
+		_last_err = BLUES_ERR_PERMANENT;
+	}
+
+	if (item->callback != NULL)
+	{
+		item->callback(note_json, success);
+	}
+	xSemaphoreGive(_worker_mutex);
+
+	if (item->success != NULL)
+	{
+		*item->success = success;
+	}
+	if (item->done != NULL)
+	{
+		xSemaphoreGive(item->done);
+	}
+}
+#endif
+
+/**
+ * @brief Set the body field names for samples pushed with sample_push()
+ * 		sample_push() can be called from interrupts and timer callbacks, it only copies the values into a
+ * 		lock-free ring supplied by the application. sample_drain() is called from the loop or the sender task,
+ * 		it adds the records with sample_add() to the sample buffer set up with sample_begin().
+ * 		Only one producer (one interrupt or callback) and one consumer are allowed.
+ * 		Call it before the interrupt or callback is started, the ring is emptied.
+ *
+ * @param fields names of the body fields, value i of a record is written as fields[i]
+ * @param count number of fields, max BLUES_ISR_VALUES
+ * @param ring array of records, must stay valid while samples are pushed
+ * @param ring_size number of records in ring, a power of 2, e.g. BLUES_ISR_RING_SIZE
+ * @return true if the fields and the ring are set
+ * @return false if count is 0 or too large, or ring_size is not a power of 2
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   // RAM for the samples waiting for a flush
+   uint8_t sample_buff[BLUES_SAMPLE_BUFF_SIZE];
+   // Records pushed from the interrupt
+   blues_isr_sample motion_ring[BLUES_ISR_RING_SIZE];
+
+   static const char *const motion_fields[] = {"x", "y", "z"};
+
+   void motion_isr(void)
+   {
+		float acc[3];
+		read_acceleration(acc);
+		// Never waits for the NoteCard
+		rak_blues.sample_push(acc, 3);
+   }
+
+   void setup()
+   {
+		rak_blues.sample_begin((char *)"motion.qo", sample_buff, sizeof(sample_buff));
+		rak_blues.sample_set_flush(20);
+		rak_blues.sample_isr_begin(motion_fields, 3, motion_ring, BLUES_ISR_RING_SIZE);
+		attachInterrupt(ACC_INT_PIN, motion_isr, RISING);
+   }
+
+   void loop()
+   {
+		rak_blues.sample_drain();
+		delay(1000);
+   }
+ * @endcode
+ */
+bool RAK_BLUES::sample_isr_begin(const char *const *fields, uint8_t count, blues_isr_sample *ring, uint16_t ring_size)
+{
+	if ((count == 0) || (count > BLUES_ISR_VALUES))
+	{
+		return false;
+	}
+	if ((ring == NULL) || (ring_size == 0) || ((ring_size & (ring_size - 1)) != 0))
+	{
+		BLUES_LOG("BLUES", "Ring size must be a power of 2");
+		return false;
+	}
+	_isr_ring = ring;
+	_isr_ring_size = ring_size;
+	_isr_head = 0;
+	_isr_tail = 0;
+	_isr_fields = fields;
+	_isr_field_count = count;
+	return true;
+}
+
+/**
+ * @brief Push a sample record into the lock-free ring, safe to call from an interrupt or timer callback
+ * 		Does not use note_json or the I2C bus. If the ring is full, the record is dropped and counted.
+ *
+ * @param values values of the sample, in the order of the fields of sample_isr_begin()
+ * @param count number of values, max BLUES_ISR_VALUES
+ * @return true if the record was stored
+ * @return false if the ring is full, not set with sample_isr_begin() or count is too large
+ */
+bool RAK_BLUES::sample_push(const float *values, uint8_t count)
+{
+	uint16_t tail = _isr_tail;
+	// Without a ring the size is 0, the record is dropped
+	if ((count > BLUES_ISR_VALUES) || ((uint16_t)(tail - _isr_head) >= _isr_ring_size))
+	{
+		_isr_dropped++;
+		return false;
+	}
+	blues_isr_sample *rec = &_isr_ring[tail & (_isr_ring_size - 1)];
+	rec->ms = millis();
+	rec->count = count;
+	for (uint8_t idx = 0; idx < count; idx++)
+	{
+		rec->value[idx] = values[idx];
+	}
+	// The record must be complete before the consumer sees the new tail
+	__sync_synchronize();
+	_isr_tail = tail + 1;
+	return true;
+}
+
+/**
+ * @brief Move the records pushed with sample_push() into the sample buffer
+ * 		Each record becomes one sample with sample_add(), the flush thresholds of the sample buffer apply.
+ * 		If the local clock is set, "time" is the time the record was pushed.
+ * 		Call it only from one task, e.g. the loop or the task that sends to the NoteCard.
+ *
+ * @param max (optional) max number of records to move, 0 (default) for all
+ * @return uint16_t number of records moved
+ */
+uint16_t RAK_BLUES::sample_drain(uint16_t max)
+{
+	uint16_t done = 0;
+	if (_isr_fields == NULL)
+	{
+		return 0;
+	}
+	while ((_isr_head != _isr_tail) && ((max == 0) || (done < max)))
+	{
+		uint16_t head = _isr_head;
+		// The record must not be read before the tail that published it
+		__sync_synchronize();
+		// Copy the record first, the slot is free for the producer after the head moved
+		blues_isr_sample rec = _isr_ring[head & (_isr_ring_size - 1)];
+		__sync_synchronize();
+		_isr_head = head + 1;
+
+		note_json.clear();
+		JsonObject body = note_json.createNestedObject("body");
+		for (uint8_t idx = 0; (idx < rec.count) && (idx < _isr_field_count); idx++)
+		{
+			body[_isr_fields[idx]] = rec.value[idx];
+		}
+		if (_time_valid)
+		{
+			body["time"] = time_now() - (millis() - rec.ms) / 1000;
+		}
+		sample_add();
+		done++;
+	}
+	return done;
+}
+
+/**
+ * @brief Get the number of records dropped by sample_push() because the ring was full
+ *
+ * @return uint32_t number of dropped records since start
+ */
+uint32_t RAK_BLUES::sample_dropped(void)
+{
+	return _isr_dropped;
+}
+
+/**
+ * @brief Set the retry policy of send_req()
+ * 		Between the tries send_req() waits a random time between half and full of
+ * 		base_delay_ms * 2^(try - 1), limited to max_delay_ms.
+ *
+ * @param max_tries max number of tries per request, 1 disables retries
+ * @param base_delay_ms delay before the first retry in milliseconds
+ * @param max_delay_ms max delay between two tries in milliseconds
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void setup()
+   {
+		// Up to 5 tries, first retry after 50 to 100 ms, never wait longer than 1 second
+		rak_blues.set_retry_policy(5, 100, 1000);
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+void RAK_BLUES::set_retry_policy(uint8_t max_tries, uint16_t base_delay_ms, uint16_t max_delay_ms)
+{
+	_retry_tries = (max_tries == 0) ? 1 : max_tries;
+	_retry_base_ms = base_delay_ms;
+	_retry_max_ms = max_delay_ms;
+}
+
+/**
+ * @brief Wait before the next try with exponential backoff and random jitter
+ *
+ * @param try_send number of the next try, starting with 1
+ */
+void RAK_BLUES::retry_delay(uint8_t try_send)
+{
+	delay(retry_wait_ms(try_send));
+}
+
+/**
+ * @brief Get the time to wait before the next try, exponential backoff with random jitter
+ *
+ * @param try_send number of the next try, starting with 1
+ * @return uint32_t time to wait in milliseconds
+ */
+uint32_t RAK_BLUES::retry_wait_ms(uint8_t try_send)
+{
+	uint32_t wait_ms = _retry_base_ms;
+	for (uint8_t idx = 1; (idx < try_send) && (wait_ms < _retry_max_ms); idx++)
+	{
+		wait_ms <<= 1;
+	}
+	if (wait_ms > _retry_max_ms)
+	{
+		wait_ms = _retry_max_ms;
+	}
+
+	// xorshift32, seeded from the timers on first use
+	if (_rand_state == 0)
+	{
+		_rand_state = micros() ^ (millis() << 16) ^ _deviceAddress;
+		if (_rand_state == 0)
+		{
+			_rand_state = 0x2545F491;
+		}
+	}
+	_rand_state ^= _rand_state << 13;
+	_rand_state ^= _rand_state >> 17;
+	_rand_state ^= _rand_state << 5;
+
+	return (wait_ms / 2) + (_rand_state % (wait_ms / 2 + 1));
+}
+
+/**
+ * @brief Serialize the request in note_json, including a binary payload added with add_payload_entry()
+ * 		The payload is Base64 encoded directly into the buffer.
+ *
+ * @param buffer buffer for the serialized request
+ * @param size size of the buffer
+ * @return size_t length of the request including the terminating newline, 0 if the request does not fit into the buffer
+ */
+size_t RAK_BLUES::serialize_req(uint8_t *buffer, size_t size)
+{
+	size_t jsonLen = serializeJson(note_json, buffer, size - 1);
+	if ((jsonLen < 2) || (jsonLen != measureJson(note_json)))
+	{
+		BLUES_LOG("BLUES", "Request too large");
+		return 0;
+	}
+
+	if (_payload != NULL)
+	{
+		// Replace the closing } with ,"payload":"<Base64>"}
+		static const char payload_key[] = ",\"payload\":\"";
+		size_t key_len = sizeof(payload_key) - 1;
+		// Request without closing }, key, Base64 with 0 terminator, "} and newline
+		if ((jsonLen - 1 + key_len + BLUES_B64_ENC_SIZE(_payload_len) + 2 + 1) > size)
+		{
+			BLUES_LOG("BLUES", "Payload too large");
+			return 0;
+		}
+		jsonLen -= 1;
+		memcpy(&buffer[jsonLen], payload_key, key_len);
+		jsonLen += key_len;
+		jsonLen += blues_b64_encode((char *)&buffer[jsonLen], _payload, _payload_len);
+		buffer[jsonLen++] = '"';
+		buffer[jsonLen++] = '}';
+	}
+
+#if BLUES_DEBUG > 0
+	buffer[jsonLen] = 0;
+	BLUES_LOG("BLUES", "Request: %s", buffer);
+#endif
+
+	buffer[jsonLen++] = '\n';
+	return jsonLen;
+}
+
+/**
+ * @brief Transmit a serialized request to the NoteCard
+ * 		The data is sent in chunks and segments so as not to overwhelm the NoteCard's interrupt buffers
+ *
+ * @param buffer data to send, must end with a newline
+ * @param len number of bytes to send
+ * @return true if all bytes were sent
+ * @return false if an I2C error occured
+ */
+bool RAK_BLUES::blues_transmit(uint8_t *buffer, size_t len)
+{
+	uint8_t *chunk = buffer;
+	uint16_t sentInSegment = 0;
+	while (len > 0)
+	{
+		// Constrain chunkLen to fit into 16 bits (blues_I2C_TX takes the buffer
+		// size as a uint16_t).
+		uint16_t chunkLen = (len > 0xFFFF) ? 0xFFFF : len;
+		// Constrain chunkLen to be <= _I2CMax().
+		chunkLen = (chunkLen > i2c_buff) ? i2c_buff : chunkLen;
+
+		delay(6);
+
+		if (!blues_I2C_TX(_deviceAddress, chunk, chunkLen))
+		{
+			BLUES_LOG("BLUES", "blues_I2C_TX error");
+			return false;
+		}
+		chunk += chunkLen;
+		len -= chunkLen;
+		sentInSegment += chunkLen;
+		if (sentInSegment > 250)
+		{
+			sentInSegment = 0;
+			delay(250);
+		}
+		delay(20);
+	}
+	return true;
+}
+
+/**
+ * @brief Receive one or more responses from the NoteCard
+ * 		Waits up to 30 seconds for each response. The responses are separated by newlines,
+ * 		the buffer is 0 terminated.
+ *
+ * @param buffer buffer for the response
+ * @param size size of the buffer
+ * @param lines (optional) number of responses to receive, default 1
+ * @param rx_len (out, optional) number of bytes received, without the 0 terminator
+ * @return true if all responses were received
+ * @return false if an I2C error occured, the NoteCard did not respond or the response did not fit into the buffer
+ */
+bool RAK_BLUES::blues_receive(uint8_t *buffer, size_t size, uint8_t lines, size_t *rx_len)
+{
+	// Loop, building a reply buffer out of received chunks.
+	bool receivedNewline = false;
+	uint8_t receivedLines = 0;
+	size_t jsonbufLen = 0;
+	uint16_t chunkLen = 0;
+	uint32_t startMs = millis();
+
+	while (true)
+	{
+		// Read the chunk
+		uint32_t available;
+		delay(6);
+
+		if (!blues_I2C_RX(_deviceAddress, &buffer[jsonbufLen], chunkLen, &available))
+		{
+			BLUES_LOG("BLUES", "blues_I2C_RX error");
+			return false;
+		}
+
+		// Count the responses in the chunk, each one restarts the timeout
+		for (uint16_t idx = 0; idx < chunkLen; idx++)
+		{
+			if (buffer[jsonbufLen + idx] == '\n')
+			{
+				receivedLines++;
+				startMs = millis();
+			}
+		}
+
+		// We've now received the chunk
+		jsonbufLen += chunkLen;
+
+		// If the last byte of the chunk is \n, chances are that we're done.  However, just so
+		// that we pull everything pending from the module, we only exit when we've received
+		// all newlines AND there's nothing left available from the module.
+		if (jsonbufLen > 0 && buffer[jsonbufLen - 1] == '\n' && receivedLines >= lines)
+		{
+			receivedNewline = true;
+		}
+
+		// Constrain chunkLen to fit into 16 bits (blues_I2C_RX takes the buffer
+		// size as a uint16_t).
+		chunkLen = (available > 0xFFFF) ? 0xFFFF : available;
+		// Constrain chunkLen to be <= _I2CMax().
+		chunkLen = (chunkLen > i2c_buff) ? i2c_buff : chunkLen;
+
+		// If there's something available on the notecard for us to receive, do it
+		if (chunkLen > 0)
+		{
+			// Check for buffer overflow, keep space for the 0 terminator
+			if ((jsonbufLen + chunkLen) >= size)
+			{
+				BLUES_LOG("BLUES", "blues_I2C_RX buffer overflow");
+				_last_err = BLUES_ERR_PERMANENT;
+				blues_resync();
+				return false;
+			}
+			continue;
+		}
+
+		// If there's nothing available AND we've received a newline, we're done
+		if (receivedNewline)
+		{
+			break;
+		}
+
+		// If we've timed out and nothing's available, exit
+		if ((millis() - startMs) >= 30000)
+		{
+			BLUES_LOG("BLUES", "No Response");
+			return false;
+		}
+
+		// Delay, simply waiting for the Note to process the request
+		delay(50);
+	}
+	buffer[jsonbufLen] = 0;
+	if (rx_len != NULL)
+	{
+		*rx_len = jsonbufLen;
+	}
+
+	BLUES_LOG("BLUES", "Response: %s", buffer);
+	return true;
+}
+
+/**
+ * @brief Read all data the NoteCard has available now, without waiting
+ *
+ * @param buffer buffer for the data
+ * @param size size of the buffer
+ * @param len (out) number of bytes read
+ * @return true if no I2C error occured
+ * @return false if an I2C error occured
+ */
+bool RAK_BLUES::blues_read_available(uint8_t *buffer, size_t size, size_t *len)
+{
+	uint32_t available = 0;
+	uint16_t chunkLen = 0;
+	*len = 0;
+
+	while (true)
+	{
+		delay(6);
+		if (!blues_I2C_RX(_deviceAddress, &buffer[*len], chunkLen, &available))
+		{
+			BLUES_LOG("BLUES", "blues_I2C_RX error");
+			return false;
+		}
+		*len += chunkLen;
+
+		chunkLen = (available > i2c_buff) ? i2c_buff : available;
+		if ((*len + chunkLen) > size)
+		{
+			chunkLen = size - *len;
+		}
+		if (chunkLen == 0)
+		{
+			return true;
+		}
+	}
+}
+
+/**
+ * @brief Parse a received response into note_json
+ *
+ * @param buffer 0 terminated response
+ * @param response if not NULL, the response of the Notecard will copied into this buffer
+ * @param resp_len max length of buffer for the Notecard response
+ * @return true if the response is valid and has no "err"
+ * @return false if the response is invalid or has "err", _last_err has the reason
+ */
+bool RAK_BLUES::parse_rsp(uint8_t *buffer, char *response, uint16_t resp_len)
+{
+	return parse_rsp(note_json, buffer, response, resp_len);
+}
+
+/**
+ * @brief Parse a received response into a JSON document
+ *
+ * @param doc JSON document for the response, the strings stay in buffer
+ * @param buffer 0 terminated response
+ * @param response if not NULL, the response of the Notecard will copied into this buffer
+ * @param resp_len max length of buffer for the Notecard response
+ * @return true if the response is valid and has no "err"
+ * @return false if the response is invalid or has "err", _last_err has the reason
+ */
+bool RAK_BLUES::parse_rsp(JsonDocument &doc, uint8_t *buffer, char *response, uint16_t resp_len)
+{
+	// Make it JSON
+	doc.clear();
+	DeserializationError error = deserializeJson(doc, (char *)buffer);
+	if (error)
+	{
+		if (error == DeserializationError::NoMemory)
+		{
+			// The same response would not fit again, a retry cannot help
+			snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "response too large");
+			BLUES_LOG("BLUES", "Response too large for the JSON document");
+			_last_err = BLUES_ERR_PERMANENT;
+			return false;
+		}
+		BLUES_LOG("BLUES", "Invalid response");
+		_last_err = BLUES_ERR_BUS;
+		return false;
+	}
+
+	// If response is requested as string
+	if (response != NULL)
+	{
+		serializeJson(doc, response, resp_len);
+	}
+
+	// Check if the Notecard reported an error
+	if (doc.containsKey("err"))
+	{
+		const char *err = doc["err"].as<const char *>();
+		if (err == NULL)
+		{
+			err = "";
+		}
+		strncpy(_last_err_str, err, BLUES_ERR_STR_SIZE - 1);
+		_last_err_str[BLUES_ERR_STR_SIZE - 1] = 0;
+		_last_err = classify_err(_last_err_str);
+		BLUES_LOG("BLUES", "Request failed, class %d: %s", _last_err, _last_err_str);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Bring the NoteCard back into a known state after a failed transfer
+ * 		A newline terminates a partly received request on the NoteCard,
+ * 		then all pending data from the NoteCard is discarded.
+ * 		The I2C bus itself is already restarted by blues_I2C_TX() and blues_I2C_RX().
+ *
+ */
+void RAK_BLUES::blues_resync(void)
+{
+	uint8_t newline = '\n';
+	uint8_t discard[i2c_buff];
+	uint32_t available = 0;
+	uint16_t chunkLen = 0;
+
+	delay(6);
+	blues_I2C_TX(_deviceAddress, &newline, 1);
+
+	// Give the NoteCard time to respond to the empty line, then drain everything
+	uint32_t startMs = millis();
+	while ((millis() - startMs) < 1000)
+	{
+		delay(6);
+		if (!blues_I2C_RX(_deviceAddress, discard, chunkLen, &available))
+		{
+			break;
+		}
+		chunkLen = (available > i2c_buff) ? i2c_buff : available;
+		if (chunkLen == 0)
+		{
+			if ((millis() - startMs) >= 100)
+			{
+				break;
+			}
+			delay(20);
+		}
+	}
+}
+
+/**
+ * @brief Get the classification of the result of the last send_req()
+ *
+ * @return blues_err_class BLUES_ERR_NONE if the last request succeeded, otherwise the error class
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void setup()
+   {
+		if (rak_blues.start_req((char *)"hub.set"))
+		{
+			rak_blues.add_string_entry((char *)"product", (char *)"com.my-company.my-name:my-project");
+			if (!rak_blues.send_req())
+			{
+				if (rak_blues.get_last_err() == BLUES_ERR_CONFIG)
+				{
+					Serial.printf("Check the settings: %s\n", rak_blues.get_last_err_str());
+				}
+			}
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+blues_err_class RAK_BLUES::get_last_err(void)
+{
+	return _last_err;
+}
+
+/**
+ * @brief Get the "err" string of the last Notecard response
+ *
+ * @return const char* error string, empty if the Notecard did not report an error
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
 
-		// If there's something available on the notecard for us to receive, do it
-		if (chunkLen > 0)
+   void setup()
+   {
+		if (rak_blues.start_req((char *)"card.location"))
 		{
-			continue;
+			if (!rak_blues.send_req())
+			{
+				Serial.printf("card.location failed: %s\n", rak_blues.get_last_err_str());
+			}
 		}
+   }
 
-		// If there's nothing available AND we've received a newline, we're done
-		if (receivedNewline)
-		{
-			break;
-		}
+   void loop()
+   {
+   }
+ * @endcode
+ */
+const char *RAK_BLUES::get_last_err_str(void)
+{
+	return _last_err_str;
+}
 
-		// Check for buffer overflow
-		if (jsonbufLen >= 4096)
-		{
-			BLUES_LOG("BLUES", "blues_I2C_RX buffer overflow");
-			break;
-		}
+/**
+ * @brief Check if it makes sense to repeat the last failed request
+ *
+ * @return true if the last request failed on the I2C bus or with a transient Notecard error
+ * @return false if the last request succeeded or failed with a configuration or permanent error
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
 
-		if (chunkLen)
-			// If we've timed out and nothing's available, exit
-			if ((millis() - startMs) >= 30000)
+   void setup()
+   {
+		for (int try_send = 0; try_send < 3; try_send++)
+		{
+			if (rak_blues.start_req((char *)"card.version"))
 			{
-				BLUES_LOG("BLUES", "No Response");
-				return false;
+				if (rak_blues.send_req())
+				{
+					break;
+				}
+				if (!rak_blues.err_is_retryable())
+				{
+					break;
+				}
 			}
+		}
+   }
 
-		// Delay, simply waiting for the Note to process the request
-		delay(50);
-	}
-
-	BLUES_LOG("BLUES", "Response: %s", in_out_buff);
+   void loop()
+   {
+   }
+ * @endcode
+ */
+bool RAK_BLUES::err_is_retryable(void)
+{
+	return (_last_err == BLUES_ERR_BUS) || (_last_err == BLUES_ERR_TRANSIENT);
+}
 
-	// Make it JSON
-	note_json.clear();
-	deserializeJson(note_json, (char *)in_out_buff);
+/**
+ * @brief Notecard error tokens and their classification
+ *
+ */
+static const struct
+{
+	const char *token;
+	blues_err_class err_class;
+} blues_err_tokens[] = {
+	{"{io}", BLUES_ERR_TRANSIENT},
+	{"{busy}", BLUES_ERR_TRANSIENT},
+	{"{timeout}", BLUES_ERR_TRANSIENT},
+	{"{network}", BLUES_ERR_TRANSIENT},
+	{"{extended-network-failure}", BLUES_ERR_TRANSIENT},
+	{"{dfu-in-progress}", BLUES_ERR_TRANSIENT},
+	{"{no-time}", BLUES_ERR_TRANSIENT},
+	{"{auth}", BLUES_ERR_CONFIG},
+	{"{registration-failure}", BLUES_ERR_CONFIG},
+	{"{product-noexist}", BLUES_ERR_CONFIG},
+	{"{device-noexist}", BLUES_ERR_CONFIG},
+	{"{template-incompatible}", BLUES_ERR_CONFIG},
+};
 
-	// If response is requested as string
-	if (response != NULL)
+/**
+ * @brief Classify a Notecard "err" string
+ * 		The Notecard adds tokens in curly brackets to the error text.
+ * 		Unknown tokens and errors without token are handled as permanent errors.
+ *
+ * @param err error string from the Notecard response
+ * @return blues_err_class class of the error
+ */
+blues_err_class RAK_BLUES::classify_err(const char *err)
+{
+	for (size_t idx = 0; idx < sizeof(blues_err_tokens) / sizeof(blues_err_tokens[0]); idx++)
 	{
-		serializeJson(note_json, response, resp_len);
+		if (strstr(err, blues_err_tokens[idx].token) != NULL)
+		{
+			return blues_err_tokens[idx].err_class;
+		}
 	}
-	return true;
+	return BLUES_ERR_PERMANENT;
 }
 
 /**
@@ -436,6 +5269,47 @@ void RAK_BLUES::add_float_entry(char *type, float value)
 	note_json[type] = value;
 }
 
+/**
+ * @brief Add binary payload to request
+ * 		Only the pointer to the data is saved. The data is Base64 encoded directly into
+ * 		the output buffer when the request is sent, no copy is made in the JSON document.
+ * 		The data must stay valid until send_req() returns.
+ *
+ * @param data payload data
+ * @param len length of payload data
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   uint8_t data[] = {0x01, 0x67, 0x01, 0x10};
+
+   void setup()
+   {
+		if (rak_blues.start_req((char *)"note.add", false))
+		{
+			rak_blues.add_string_entry((char *)"file", (char *)"data.qo");
+			rak_blues.add_payload_entry(data, sizeof(data));
+			if (rak_blues.send_req())
+			{
+				request_success = true;
+			}
+		}
+   }
+
+   void loop()
+   {
+   }
+ * @endcode
+ */
+void RAK_BLUES::add_payload_entry(const uint8_t *data, size_t len)
+{
+	_payload = data;
+	_payload_len = len;
+}
+
 /**
  * @brief Add nested C-String entry to request
  *
@@ -1656,11 +6530,12 @@ bool RAK_BLUES::get_2lv_nested_bool_entry(char *type, char *nested, char *nested
 
 /**
  * @brief Encode a char buffer to Base64
+ * 		Kept for compatibility, uses blues_b64_encode()
  *
- * @param encoded (out) encoded string
+ * @param encoded (out) encoded string, needs BLUES_B64_ENC_SIZE(len) bytes
  * @param string char buffer for encoding
  * @param len length of buffer
- * @return int length of encoded string
+ * @return int length of encoded string including the 0 terminator
  * @par Example
  * @code
    #include <Arduino.h>
@@ -1670,7 +6545,7 @@ bool RAK_BLUES::get_2lv_nested_bool_entry(char *type, char *nested, char *nested
 
 	char data[] = {0x00, 0x01, 0x02, 0x03};
 	int data_len = 4;
-	char payload_b86[255];
+	char payload_b86[BLUES_B64_ENC_SIZE(4)];
 
 	void setup()
 	{
@@ -1707,35 +6582,312 @@ bool RAK_BLUES::get_2lv_nested_bool_entry(char *type, char *nested, char *nested
  */
 int RAK_BLUES::myJB64Encode(char *encoded, const char *string, int len)
 {
-	int i;
-	char *p;
-
-	p = encoded;
-	for (i = 0; i < len - 2; i += 3)
+	if (len < 0)
 	{
-		*p++ = basis_64[(string[i] >> 2) & 0x3F];
-		*p++ = basis_64[((string[i] & 0x3) << 4) | ((int)(string[i + 1] & 0xF0) >> 4)];
-		*p++ = basis_64[((string[i + 1] & 0xF) << 2) | ((int)(string[i + 2] & 0xC0) >> 6)];
-		*p++ = basis_64[string[i + 2] & 0x3F];
+		len = 0;
 	}
-	if (i < len)
+	return blues_b64_encode(encoded, (const uint8_t *)string, len) + 1;
+}
+
+/**
+ * @brief Read all pending inbound notes from a notefile, e.g. data.qi
+ * 		Each note is read with note.get and deleted on the NoteCard only after the callback got it.
+ * 		The Base64 "payload" of the note is decoded directly from the response into buffer.
+ * 		If buffer is NULL, the payload is decoded in place inside in_out_buff.
+ * 		During the callback the complete note is available in note_json, e.g. for the "body".
+ * 		If a payload is invalid or does not fit into buffer, the reading stops and the note stays on the NoteCard.
+ *
+ * @param file name of the inbound notefile, e.g. data.qi
+ * @param buffer (out) buffer for the decoded payload or NULL
+ * @param size size of the buffer
+ * @param callback function called for each note with the decoded payload, len is 0 if the note has no payload
+ * @param max_notes max number of notes to read in one call
+ * @return uint16_t number of notes read and deleted
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   uint8_t rx_buffer[256];
+
+   void rx_cb(uint8_t *data, size_t len)
+   {
+		Serial.printf("Received %d bytes\n", len);
+   }
+
+   void setup()
+   {
+   }
+
+   void loop()
+   {
+		rak_blues.get_inbound_notes((char *)"data.qi", rx_buffer, sizeof(rx_buffer), rx_cb);
+		delay(60000);
+   }
+ * @endcode
+ */
+uint16_t RAK_BLUES::get_inbound_notes(char *file, uint8_t *buffer, size_t size, void (*callback)(uint8_t *data, size_t len), uint16_t max_notes)
+{
+	uint16_t notes = 0;
+
+	while (notes < max_notes)
 	{
-		*p++ = basis_64[(string[i] >> 2) & 0x3F];
-		if (i == (len - 1))
+		// Read the oldest note without removing it, the request can be repeated
+		start_req((char *)"note.get");
+		add_string_entry((char *)"file", file);
+		if (!send_req())
 		{
-			*p++ = basis_64[((string[i] & 0x3) << 4)];
-			*p++ = '=';
+			// {note-noexist} means the queue is empty
+			if (strstr(_last_err_str, "{note-noexist}") == NULL)
+			{
+				BLUES_LOG("BLUES", "note.get failed: %s", _last_err_str);
+			}
+			break;
 		}
-		else
+
+		size_t len = 0;
+		uint8_t *target = buffer;
+		const char *payload = note_json["payload"].as<const char *>();
+		if (payload != NULL)
+		{
+			size_t payload_len = strlen(payload);
+			size_t target_size = size;
+			if (target == NULL)
+			{
+				// The response string is writable, decode it in place
+				target = (uint8_t *)payload;
+				target_size = payload_len;
+			}
+			if (!blues_b64_decode(target, target_size, payload, payload_len, &len))
+			{
+				// Keep the note, it can be read later with a larger buffer
+				snprintf(_last_err_str, BLUES_ERR_STR_SIZE, "payload invalid or too large");
+				_last_err = BLUES_ERR_PERMANENT;
+				BLUES_LOG("BLUES", "Payload invalid or too large, note kept");
+				break;
+			}
+		}
+		if (callback != NULL)
+		{
+			callback(target, len);
+		}
+
+		// Remove the note that was just passed to the callback, it is still the oldest one.
+		// With delete:true a repeated request could remove a note that was never seen
+		start_req((char *)"note.get", false);
+		add_string_entry((char *)"file", file);
+		add_bool_entry((char *)"delete", true);
+		if (!send_req())
+		{
+			BLUES_LOG("BLUES", "Delete of inbound note failed: %s", _last_err_str);
+			break;
+		}
+		notes++;
+	}
+	return notes;
+}
+
+/**
+ * @brief Attach an interrupt to the GPIO connected to the NoteCard ATTN pin
+ * 		The ATTN pin goes high when an event armed with attn_arm() happens.
+ * 		Instead of polling the NoteCard over I2C, the MCU can sleep until the callback wakes it up.
+ * 		The callback is called in interrupt context, it should only signal the application,
+ * 		e.g. with api_wake_loop() or a semaphore. Do not send requests from the callback.
+ *
+ * @param pin GPIO connected to the NoteCard ATTN pin
+ * @param callback (optional) function called from the interrupt when ATTN goes high
+ * @return true if the interrupt was attached
+ * @return false if the GPIO has no interrupt, checked on cores that define NOT_AN_INTERRUPT
+ * @par Example
+ * @code
+   #include <Arduino.h>
+   #include <blues-minimal-i2c.h>
+   // I2C functions for Blues NoteCard
+   RAK_BLUES rak_blues;
+
+   void attn_cb(void)
+   {
+		api_wake_loop(BLUES_ATTN);
+   }
+
+   void setup()
+   {
+		rak_blues.attn_begin(WB_IO5, attn_cb);
+		rak_blues.attn_arm(BLUES_ATTN_FILES, (char *)"data.qi");
+   }
+
+   void loop()
+   {
+		if (rak_blues.attn_pending())
 		{
-			*p++ = basis_64[((string[i] & 0x3) << 4) | ((int)(string[i + 1] & 0xF0) >> 4)];
-			*p++ = basis_64[((string[i + 1] & 0xF) << 2)];
+			rak_blues.get_inbound_notes((char *)"data.qi", NULL, 0, rx_cb);
+			// Arm again for the next event
+			rak_blues.attn_arm(BLUES_ATTN_FILES, (char *)"data.qi");
 		}
-		*p++ = '=';
+   }
+ * @endcode
+ */
+bool RAK_BLUES::attn_begin(uint8_t pin, void (*callback)(void))
+{
+#ifdef NOT_AN_INTERRUPT
+	// digitalPinToInterrupt() is unsigned on some cores, compare with the marker of the core
+	if ((int)digitalPinToInterrupt(pin) == (int)NOT_AN_INTERRUPT)
+	{
+		BLUES_LOG("BLUES", "ATTN pin %d has no interrupt", pin);
+		return false;
+	}
+#endif
+	if (_attn_pin >= 0)
+	{
+		detachInterrupt(digitalPinToInterrupt(_attn_pin));
+	}
+	_attn_pin = pin;
+	_attn_cb = callback;
+	_attn_fired = false;
+	pinMode(pin, INPUT);
+	attachInterrupt(digitalPinToInterrupt(pin), attn_isr, RISING);
+	return true;
+}
+
+/**
+ * @brief Detach the ATTN interrupt
+ *
+ */
+void RAK_BLUES::attn_end(void)
+{
+	if (_attn_pin >= 0)
+	{
+		detachInterrupt(digitalPinToInterrupt(_attn_pin));
+		_attn_pin = -1;
+	}
+	_attn_cb = NULL;
+	_attn_fired = false;
+}
+
+/**
+ * @brief Interrupt handler for the ATTN pin
+ *
+ */
+void RAK_BLUES::attn_isr(void)
+{
+	_attn_fired = true;
+	if (_attn_cb != NULL)
+	{
+		_attn_cb();
+	}
+}
+
+/**
+ * @brief Arm the NoteCard ATTN pin with card.attn
+ * 		ATTN is set low and goes high on the next armed event.
+ * 		After an event, ATTN stays high until it is armed again.
+ *
+ * @param events combination of BLUES_ATTN_FILES, BLUES_ATTN_MOTION and BLUES_ATTN_LOCATION
+ * @param file (optional) notefile to watch with BLUES_ATTN_FILES, e.g. data.qi, NULL watches all files
+ * @param seconds (optional) ATTN goes high after this time even without an event, 0 to disable
+ * @return true if card.attn was accepted
+ * @return false if card.attn failed
+ */
+bool RAK_BLUES::attn_arm(uint8_t events, char *file, uint32_t seconds)
+{
+	char mode[32] = "arm";
+	if ((events & BLUES_ATTN_FILES) == BLUES_ATTN_FILES)
+	{
+		strcat(mode, ",files");
+	}
+	if ((events & BLUES_ATTN_MOTION) == BLUES_ATTN_MOTION)
+	{
+		strcat(mode, ",motion");
+	}
+	if ((events & BLUES_ATTN_LOCATION) == BLUES_ATTN_LOCATION)
+	{
+		strcat(mode, ",location");
+	}
+
+	start_req((char *)"card.attn");
+	add_string_entry((char *)"mode", mode);
+	if ((file != NULL) && ((events & BLUES_ATTN_FILES) == BLUES_ATTN_FILES))
+	{
+		JsonArray files = note_json.createNestedArray("files");
+		files.add(file);
+	}
+	if (seconds != 0)
+	{
+		add_uint32_entry((char *)"seconds", seconds);
+	}
+
+	// Arming sets ATTN low, an event during the request is a new rising edge
+	_attn_fired = false;
+	if (!send_req())
+	{
+		return false;
+	}
+	_attn_events = events;
+	return true;
+}
+
+/**
+ * @brief Disarm the NoteCard ATTN pin, ATTN stays low
+ *
+ * @return true if card.attn was accepted
+ * @return false if card.attn failed
+ */
+bool RAK_BLUES::attn_disarm(void)
+{
+	start_req((char *)"card.attn");
+	add_string_entry((char *)"mode", (char *)"disarm");
+	if (!send_req())
+	{
+		return false;
+	}
+	_attn_events = 0;
+	_attn_fired = false;
+	return true;
+}
+
+/**
+ * @brief Check if the ATTN interrupt was triggered and clear the flag
+ * 		Does not access the I2C bus.
+ *
+ * @return true if ATTN went high since the last call or since attn_arm()
+ * @return false if no event
+ */
+bool RAK_BLUES::attn_pending(void)
+{
+	if (!_attn_fired)
+	{
+		return false;
+	}
+	_attn_fired = false;
+	return true;
+}
+
+/**
+ * @brief Ask the NoteCard which events set ATTN
+ * 		Changed notefiles are reported by the NoteCard. If ATTN is set without changed files,
+ * 		the other armed events (motion, location) are returned.
+ *
+ * @return uint8_t combination of BLUES_ATTN_FILES, BLUES_ATTN_MOTION and BLUES_ATTN_LOCATION, 0 if no event
+ */
+uint8_t RAK_BLUES::attn_get_events(void)
+{
+	start_req((char *)"card.attn");
+	if (!send_req())
+	{
+		return 0;
 	}
 
-	*p++ = '\0';
-	return p - encoded;
+	if (note_json["files"].size() != 0)
+	{
+		return BLUES_ATTN_FILES;
+	}
+	if (note_json["set"].as<bool>())
+	{
+		return _attn_events & ~BLUES_ATTN_FILES;
+	}
+	return 0;
 }
 
 /**
@@ -1833,8 +6985,12 @@ bool RAK_BLUES::blues_I2C_RX(uint16_t device_address_, uint8_t *buffer_, uint16_
 		default:
 			BLUES_LOG("BLUES_I2C", "RX unknown error encounter during I2C transmission");
 		}
+		// Restart the bus before the next try, only the last failed try counts for the fallback
+		I2C_RST(i == 2);
+	}
+	if (transmission_error)
+	{
 		result = false;
-		I2C_RST();
 	}
 
 	// Delay briefly ensuring that the Notecard can
@@ -1886,6 +7042,11 @@ bool RAK_BLUES::blues_I2C_RX(uint16_t device_address_, uint8_t *buffer_, uint16_
 				}
 			}
 		}
+		if (!result)
+		{
+			// A garbled answer is the typical error of a marginal clock, it counts for the fallback
+			I2C_RST();
+		}
 	}
 	return result;
 }
@@ -14,6 +14,9 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <ArduinoJson.h>
+#include "blues-base64.h"
+#include "blues-cobs.h"
+#include "blues-md5.h"
 
 /** Default Notecard I2C address */
 #define BLUES_I2C_ADDRESS 0x17
@@ -48,6 +51,359 @@
 #define BLUES_LOG(...)
 #endif
 
+#ifndef BLUES_RETRY_TRIES
+/** Default number of tries per request */
+#define BLUES_RETRY_TRIES 3
+#endif
+
+#ifndef BLUES_RETRY_BASE_MS
+/** Default delay before the first retry in milliseconds */
+#define BLUES_RETRY_BASE_MS 100
+#endif
+
+#ifndef BLUES_RETRY_MAX_MS
+/** Default max delay between two tries in milliseconds */
+#define BLUES_RETRY_MAX_MS 2000
+#endif
+
+#ifndef BLUES_BATCH_MAX
+/** Max number of requests and commands in one batch, max 32 */
+#define BLUES_BATCH_MAX 16
+#endif
+
+#ifndef BLUES_CONFIG_SLOTS
+/** Number of settings handled by the configuration manager */
+#define BLUES_CONFIG_SLOTS 8
+#endif
+
+#ifndef BLUES_CONFIG_DOC_SIZE
+/** JSON document size to compare a setting request with the NoteCard settings */
+#define BLUES_CONFIG_DOC_SIZE 512
+#endif
+
+#ifndef BLUES_PIPE_MAX
+/** Max number of pipelined requests in flight */
+#define BLUES_PIPE_MAX 4
+#endif
+
+#ifndef BLUES_SLOT_BUFF_SIZE
+/** Buffer size of a request slot, for the serialized request and the response */
+#define BLUES_SLOT_BUFF_SIZE 512
+#endif
+
+#ifndef BLUES_SLOT_DOC_SIZE
+/** JSON document size for the response of a request slot, large enough for e.g. hub.status or card.location */
+#define BLUES_SLOT_DOC_SIZE 512
+#endif
+
+#ifndef BLUES_SAMPLE_BUFF_SIZE
+/** Suggested size of the sample buffer supplied to sample_begin() */
+#define BLUES_SAMPLE_BUFF_SIZE 1024
+#endif
+
+#ifndef BLUES_RSP_RESERVE
+/** Space kept in in_out_buff behind a sample flush request for the note.add response */
+#define BLUES_RSP_RESERVE 128
+#endif
+
+#ifndef BLUES_ISR_RING_SIZE
+/** Suggested number of records in the ring supplied to sample_isr_begin(), must be a power of 2 */
+#define BLUES_ISR_RING_SIZE 16
+#endif
+
+#ifndef BLUES_ISR_VALUES
+/** Max number of values in a record for sample_push() */
+#define BLUES_ISR_VALUES 4
+#endif
+
+#ifndef BLUES_TEMPLATE_MAX
+/** Max number of note templates in the template registry */
+#define BLUES_TEMPLATE_MAX 4
+#endif
+
+#ifndef BLUES_CACHE_RULES
+/** Max number of cached requests */
+#define BLUES_CACHE_RULES 4
+#endif
+
+#ifndef BLUES_CACHE_ENTRIES
+/** Suggested number of cached responses supplied to cache_begin() */
+#define BLUES_CACHE_ENTRIES 4
+#endif
+
+#ifndef BLUES_CACHE_RSP_SIZE
+/** Max length of a cached response, card.version needs about 400 bytes */
+#define BLUES_CACHE_RSP_SIZE 448
+#endif
+
+#ifndef BLUES_BINARY_CHUNK
+/** Max bytes per card.binary.put and card.binary.get, the COBS encoded chunk and the request must fit into in_out_buff */
+#define BLUES_BINARY_CHUNK ((JSON_BUFF_SIZE - 256) / 255 * 254)
+#endif
+
+#ifndef BLUES_WEB_CHUNK
+/** Max bytes per web.post fragment, the raw chunk and the Base64 encoded request share in_out_buff */
+#define BLUES_WEB_CHUNK (((JSON_BUFF_SIZE - 512) * 3 / 7) / 3 * 3)
+#endif
+
+#ifndef BLUES_DOWNLOAD_CHUNK
+/** Max bytes per dfu.get or web.get range, the Base64 encoded range and the response must fit into in_out_buff */
+#define BLUES_DOWNLOAD_CHUNK ((JSON_BUFF_SIZE - 256) / 4 * 3)
+#endif
+
+#ifndef BLUES_DOWNLOAD_RESUMES
+/** Max I2C restarts per range before a download stops */
+#define BLUES_DOWNLOAD_RESUMES 3
+#endif
+
+#ifndef BLUES_I2C_SDA
+#if defined(PIN_WIRE_SDA) && defined(PIN_WIRE_SCL)
+/** SDA GPIO for the bus recovery, define BLUES_I2C_SDA and BLUES_I2C_SCL if the core has no PIN_WIRE_SDA */
+#define BLUES_I2C_SDA PIN_WIRE_SDA
+/** SCL GPIO for the bus recovery */
+#define BLUES_I2C_SCL PIN_WIRE_SCL
+#endif
+#endif
+
+#ifndef BLUES_USE_RTOS
+#if (defined(NRF52_SERIES) || defined(ESP32)) && !defined(RUI_SDK)
+/** Worker task for requests from several tasks, only on cores with FreeRTOS API, not on RUI3 */
+#define BLUES_USE_RTOS 1
+#else
+#define BLUES_USE_RTOS 0
+#endif
+#endif
+
+#ifndef BLUES_WORKER_QUEUE
+/** Max number of requests waiting for the worker task */
+#define BLUES_WORKER_QUEUE 4
+#endif
+
+#ifndef BLUES_WORKER_REQ_SIZE
+/** Max length of a request for the worker task */
+#define BLUES_WORKER_REQ_SIZE 256
+#endif
+
+#ifndef BLUES_WORKER_STACK
+/** Stack size of the worker task in bytes */
+#define BLUES_WORKER_STACK 4096
+#endif
+
+/** I2C Standard-mode clock */
+#define BLUES_I2C_STANDARD 100000
+/** I2C Fast-mode clock */
+#define BLUES_I2C_FAST 400000
+
+#ifndef BLUES_I2C_FALLBACK_ERRORS
+/** Failed transfers in Fast-mode before the clock falls back to Standard-mode */
+#define BLUES_I2C_FALLBACK_ERRORS 3
+#endif
+
+#ifndef BLUES_ERR_STR_SIZE
+/** Max length of the saved Notecard error string */
+#define BLUES_ERR_STR_SIZE 64
+#endif
+
+/** card.attn event, a watched notefile changed, e.g. new inbound notes */
+#define BLUES_ATTN_FILES 0x01
+/** card.attn event, motion was detected */
+#define BLUES_ATTN_MOTION 0x02
+/** card.attn event, a new location is available */
+#define BLUES_ATTN_LOCATION 0x04
+
+/**
+ * @brief Classification of the last request result
+ *
+ */
+enum blues_err_class
+{
+	BLUES_ERR_NONE = 0,	 ///< No error
+	BLUES_ERR_BUS,		 ///< I2C error or no response from the Notecard
+	BLUES_ERR_TRANSIENT, ///< Temporary Notecard error, e.g. {io} or {busy}, retry can succeed
+	BLUES_ERR_CONFIG,	 ///< Notecard configuration error, e.g. {auth}, retry will fail until fixed
+	BLUES_ERR_PERMANENT	 ///< Invalid or unsupported request, retry will always fail
+};
+
+/**
+ * @brief Applied NoteCard settings, saved by the application between boots
+ *
+ */
+struct blues_config_state
+{
+	uint32_t device_hash;					///< Hash of the NoteCard device UID, 0 if unknown
+	uint32_t slot_hash[BLUES_CONFIG_SLOTS]; ///< Hash of the last applied request per setting, 0 if unknown
+	uint32_t i2c_clock;						///< Working I2C clock in Hz, 0 if unknown
+};
+
+/**
+ * @brief Pipelined request waiting for its response
+ *
+ */
+struct blues_pipe_entry
+{
+	uint32_t id;	  ///< "id" of the request
+	uint32_t sent_ms; ///< Time the request was sent
+};
+
+/**
+ * @brief State of a request slot
+ *
+ */
+enum blues_slot_state
+{
+	BLUES_SLOT_FREE = 0, ///< Slot can be used for a new request
+	BLUES_SLOT_QUEUED,	 ///< Request is serialized and waits for the bus
+	BLUES_SLOT_TX,		 ///< Request is being sent
+	BLUES_SLOT_RX		 ///< Waiting for the response
+};
+
+/**
+ * @brief Request slot for non-blocking sending
+ *
+ */
+struct blues_slot
+{
+	uint8_t buff[BLUES_SLOT_BUFF_SIZE];          ///< Serialized request, the response is received behind it
+	StaticJsonDocument<BLUES_SLOT_DOC_SIZE> rsp; ///< Parsed response
+	blues_slot_state state = BLUES_SLOT_FREE;    ///< State of the slot
+	size_t len = 0;                              ///< Length of the serialized request
+	size_t pos = 0;                              ///< Bytes sent or received
+	uint32_t rx_avail = 0;                       ///< Bytes available on the NoteCard
+	uint16_t segment = 0;                        ///< Bytes sent since the last segment delay
+	uint8_t tries = 0;                           ///< Number of failed tries
+	bool idempotent = true;                      ///< Request can be repeated without side effects
+	bool is_cmd = false;                         ///< Command without response
+	uint32_t seq = 0;                            ///< Queue order
+	uint32_t next_ms = 0;                        ///< Time of the next bus step
+	uint32_t start_ms = 0;                       ///< Start of the wait for the response
+};
+
+/**
+ * @brief Header of a sample in the sample buffer, followed by the serialized body
+ *
+ */
+struct blues_sample_hdr
+{
+	uint16_t len; ///< Length of the serialized body
+	uint8_t sent; ///< Sample was sent, waits for removal
+	uint8_t rsv;  ///< Reserved
+	uint32_t ms;  ///< Time the sample was added
+};
+
+/**
+ * @brief Sample record pushed from an interrupt or timer callback
+ *
+ */
+struct blues_isr_sample
+{
+	uint32_t ms;					///< Time the record was pushed
+	uint8_t count;					///< Number of values
+	float value[BLUES_ISR_VALUES]; ///< Values in the order of the fields
+};
+
+/**
+ * @brief Type of a note template field
+ *
+ */
+enum blues_field_type
+{
+	BLUES_FIELD_STRING = 0, ///< String, size is the max length
+	BLUES_FIELD_INT,		///< Signed integer, size 1, 2, 3, 4 or 8 bytes
+	BLUES_FIELD_UINT,		///< Unsigned integer, size 1, 2, 3 or 4 bytes
+	BLUES_FIELD_FLOAT,		///< Floating point, size 2, 4 or 8 bytes
+	BLUES_FIELD_BOOL		///< Boolean
+};
+
+/**
+ * @brief Field of a note template body
+ *
+ */
+struct blues_template_field
+{
+	const char *name;	   ///< Name of the body field
+	blues_field_type type; ///< Type of the field
+	uint8_t size;		   ///< Size in bytes, max length for strings
+};
+
+/**
+ * @brief Note template in the template registry
+ *
+ */
+struct blues_template
+{
+	char file[32];                      ///< Notefile of the template
+	const blues_template_field *fields; ///< Body fields
+	uint8_t count;                      ///< Number of body fields
+	uint16_t payload_len;               ///< Max length of the binary payload
+	bool registered;                    ///< note.template was sent
+};
+
+/**
+ * @brief Cached request with its time to live
+ *
+ */
+struct blues_cache_rule
+{
+	char req[24];	 ///< Name of the cached request
+	char inval[24];	 ///< Request that drops the cached responses
+	uint32_t ttl_ms; ///< Time a response is valid, 0 until it is dropped
+};
+
+/**
+ * @brief Cached response
+ *
+ */
+struct blues_cache_entry
+{
+	uint32_t key;					///< Hash of the serialized request
+	uint32_t ms;					///< Time the response was stored
+	uint8_t rule;					///< Index of the cache rule
+	bool valid;						///< Entry is in use
+	uint16_t len;					///< Length of the response
+	char rsp[BLUES_CACHE_RSP_SIZE]; ///< Serialized response
+};
+
+/**
+ * @brief Location fix of the NoteCard
+ *
+ */
+struct blues_location
+{
+	double lat;		///< Latitude in degrees
+	double lon;		///< Longitude in degrees
+	float dop;		///< Dilution of precision, lower is more accurate, 0 if unknown
+	uint32_t time;	///< UTC time of the fix, 0 if unknown
+	uint32_t age_s; ///< Age of the fix in seconds
+	bool valid;		///< A fix is known
+};
+
+#if BLUES_USE_RTOS > 0
+/**
+ * @brief Request queued for the worker task
+ *
+ */
+struct blues_worker_req
+{
+	char req[BLUES_WORKER_REQ_SIZE];				   ///< Request as JSON text
+	void (*callback)(JsonDocument &rsp, bool success); ///< Called by the worker task with the response, can be NULL
+	SemaphoreHandle_t done;							   ///< Given when the request is finished, can be NULL
+	bool *success;									   ///< Result of the request, can be NULL
+};
+#endif
+
+/**
+ * @brief Throughput of one chunk of a streamed transfer
+ *
+ */
+struct blues_xfer_stats
+{
+	size_t offset;		  ///< Position of the chunk
+	size_t len;			  ///< Length of the chunk
+	size_t total;		  ///< Total length of the transfer
+	uint32_t ms;		  ///< Time for the chunk, including retries
+	uint32_t bytes_per_s; ///< Throughput of the chunk
+};
+
 /**
  * @brief Class RAK_BLUES
  * 
@@ -67,17 +423,88 @@ public:
 	/** NoteCard default I2C address */
 	uint8_t note_i2c_addr = BLUES_I2C_ADDRESS;
 
-	/** Base64 helper */
-	const char basis_64[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-	bool start_req(char *request);
+	bool start_req(char *request, bool idempotent = true);
 	bool send_req(char *response = NULL, uint16_t resp_len = 0);
+	bool start_cmd(char *request);
+	bool send_cmd(void);
+	void batch_begin(void);
+	bool batch_add(void);
+	bool batch_send(void (*callback)(uint8_t idx, bool success) = NULL);
+	bool config_begin(blues_config_state *state, bool check_device = true);
+	bool config_add(uint8_t slot, char *readback = NULL);
+	bool config_apply(void (*callback)(uint8_t idx, bool success) = NULL);
+	bool config_changed(void);
+	bool pipe_send(uint32_t *id = NULL);
+	uint8_t pipe_poll(void (*callback)(uint32_t id, bool success), uint32_t wait_ms = 0);
+	uint8_t pipe_flush(void (*callback)(uint32_t id, bool success));
+	uint8_t pipe_pending(void);
+	void slot_begin(blues_slot *slots);
+	bool slot_queue(void);
+	uint8_t slot_free(void);
+	bool slot_process(void (*callback)(JsonDocument &rsp, bool success) = NULL);
+	bool sample_begin(char *file, uint8_t *buffer, size_t size, bool burst = false, bool sync = false);
+	void sample_set_flush(uint16_t max_count, size_t max_bytes = 0, uint32_t max_age_s = 0);
+	bool sample_add(void);
+	bool sample_due(void);
+	uint16_t sample_count(void);
+	bool sample_flush(void);
+	bool sample_isr_begin(const char *const *fields, uint8_t count, blues_isr_sample *ring, uint16_t ring_size);
+	bool sample_push(const float *values, uint8_t count);
+	uint16_t sample_drain(uint16_t max = 0);
+	uint32_t sample_dropped(void);
+	bool sync_begin(uint32_t max_delay_s, uint16_t max_pending = 0, uint16_t outbound_min = 0);
+	void sync_note(uint16_t count = 1, bool urgent = false);
+	uint16_t sync_pending(void);
+	bool sync_process(void);
+	int8_t template_add(char *file, const blues_template_field *fields, uint8_t count, uint16_t payload_len = 0);
+	bool template_apply(void);
+	bool template_check(void);
+	void cache_begin(blues_cache_entry *entries, uint8_t count);
+	bool cache_add(char *request, uint32_t ttl_s, char *invalidated_by = NULL);
+	void cache_invalidate(char *request = NULL);
+	bool time_begin(uint32_t resync_s = 86400, bool stamp_samples = false);
+	bool time_sync(void);
+	bool time_process(void);
+	uint32_t time_now(void);
+	bool time_valid(void);
+	int32_t time_drift_ppm(void);
+	bool location_begin(uint32_t max_age_s, uint32_t gnss_s = 0);
+	bool location_get(blues_location *location);
+	bool location_update(void);
+	uint32_t location_age(void);
+	bool ping(uint32_t *available = NULL);
+	bool ping_cached(uint32_t max_age_ms = 1000);
+	void set_i2c_clock(uint32_t clock_hz);
+	uint32_t get_i2c_recoveries(void);
+	uint32_t i2c_negotiate(uint32_t saved_hz = 0);
+	uint32_t get_i2c_clock(void);
+#if BLUES_USE_RTOS > 0
+	bool worker_begin(uint8_t queue_len = BLUES_WORKER_QUEUE, uint8_t priority = 1);
+	bool worker_submit(const char *request, void (*callback)(JsonDocument &rsp, bool success) = NULL, SemaphoreHandle_t done = NULL, bool *success = NULL);
+	bool worker_submit(JsonDocument &request, void (*callback)(JsonDocument &rsp, bool success) = NULL, SemaphoreHandle_t done = NULL, bool *success = NULL);
+	bool worker_lock(uint32_t wait_ms = portMAX_DELAY);
+	void worker_unlock(void);
+	uint8_t worker_pending(void);
+#endif
+	bool binary_reset(void);
+	bool binary_info(size_t *len, size_t *max = NULL);
+	bool binary_put(const uint8_t *data, size_t len);
+	bool binary_get(uint8_t *data, size_t offset, size_t len);
+	bool web_post_stream(char *route, char *name, size_t total, size_t (*reader)(uint8_t *buffer, size_t offset, size_t len),
+						 void (*progress)(blues_xfer_stats *stats) = NULL, bool put = false);
+	bool dfu_get_stream(size_t total, bool (*sink)(const uint8_t *data, size_t offset, size_t len), size_t *offset,
+						const char *md5 = NULL, void (*progress)(blues_xfer_stats *stats) = NULL, blues_md5_ctx *md5_ctx = NULL);
+	bool download_verified(void);
+	bool web_get_stream(char *route, char *name, size_t total, bool (*sink)(const uint8_t *data, size_t offset, size_t len), size_t *offset,
+						void (*progress)(blues_xfer_stats *stats) = NULL);
+	void set_retry_policy(uint8_t max_tries, uint16_t base_delay_ms = BLUES_RETRY_BASE_MS, uint16_t max_delay_ms = BLUES_RETRY_MAX_MS);
 
 	void add_string_entry(char *type, char *value);
 	void add_bool_entry(char *type, bool value);
 	void add_int32_entry(char *type, int32_t value);
 	void add_uint32_entry(char *type, uint32_t value);
 	void add_float_entry(char *type, float value);
+	void add_payload_entry(const uint8_t *data, size_t len);
 	void add_nested_string_entry(char *type, char *nested, char *value);
 	void add_nested_int32_entry(char *type, char *nested, int32_t value);
 	void add_nested_uint32_entry(char *type, char *nested, uint32_t value);
@@ -108,12 +535,267 @@ public:
 	bool get_2lv_nested_bool_entry(char *type, char *nested, char *nested2, bool &value);
 
 	int myJB64Encode(char *encoded, const char *string, int len);
+	uint16_t get_inbound_notes(char *file, uint8_t *buffer, size_t size, void (*callback)(uint8_t *data, size_t len), uint16_t max_notes = 16);
+
+	bool attn_begin(uint8_t pin, void (*callback)(void) = NULL);
+	void attn_end(void);
+	bool attn_arm(uint8_t events, char *file = NULL, uint32_t seconds = 0);
+	bool attn_disarm(void);
+	bool attn_pending(void);
+	uint8_t attn_get_events(void);
+
+	blues_err_class get_last_err(void);
+	const char *get_last_err_str(void);
+	bool err_is_retryable(void);
 
 private:
-	void I2C_RST(void);
+	void I2C_RST(bool failed = true);
+	bool i2c_verify(uint32_t clock_hz);
+#if BLUES_USE_RTOS > 0
+	static void worker_task(void *param);
+	void worker_process(blues_worker_req *item);
+#endif
+#if defined(BLUES_I2C_SDA) && defined(BLUES_I2C_SCL)
+	void i2c_bus_clear(void);
+#endif
+	blues_err_class classify_err(const char *err);
+	size_t serialize_req(uint8_t *buffer, size_t size);
+	bool blues_request(uint8_t *buffer, size_t size, char *response, uint16_t resp_len);
+	bool blues_exchange(JsonDocument &doc, uint8_t *buffer, size_t jsonLen, size_t size, bool idempotent, char *response, uint16_t resp_len);
+	void batch_drop_last(size_t start);
+	bool batch_transient(const char *rsp, uint8_t lines);
+	void pipe_remove(uint8_t idx);
+	bool config_readback(size_t start, char *readback);
+	bool blues_transmit(uint8_t *buffer, size_t len);
+	bool blues_receive(uint8_t *buffer, size_t size, uint8_t lines = 1, size_t *rx_len = NULL);
+	bool blues_read_available(uint8_t *buffer, size_t size, size_t *len);
+	bool parse_rsp(uint8_t *buffer, char *response, uint16_t resp_len);
+	bool parse_rsp(JsonDocument &doc, uint8_t *buffer, char *response, uint16_t resp_len);
+	void blues_resync(void);
+	bool sample_send_array(void);
+	bool sample_send_burst(void);
+	size_t sample_read(size_t pos, blues_sample_hdr *hdr);
+	void sample_mark_sent(uint16_t count, uint32_t skip_mask = 0);
+	void sample_pop(void);
+	bool template_prepare(bool can_register);
+	blues_template *template_find(void);
+	bool template_register(blues_template *tpl);
+	bool cache_request(char *response, uint16_t resp_len);
+	bool location_fresh(void);
+	bool location_gnss(bool on);
+	void cache_sent(void);
+	void cache_store(uint8_t rule, uint32_t key);
+	int8_t cache_rule_find(const char *request);
+	bool download_stream(char *request, char *route, char *name, size_t total, bool (*sink)(const uint8_t *data, size_t offset, size_t len),
+						 size_t *offset, const char *md5, void (*progress)(blues_xfer_stats *stats), blues_md5_ctx *md5_ctx);
+	void retry_delay(uint8_t try_send);
+	uint32_t retry_wait_ms(uint8_t try_send);
+	void slot_retry(blues_slot *slot, bool can_retry, void (*callback)(JsonDocument &rsp, bool success));
+	void slot_finish(blues_slot *slot, bool success, void (*callback)(JsonDocument &rsp, bool success));
 	bool blues_I2C_TX(uint16_t device_address_, uint8_t *buffer_, uint16_t size_);
 	bool blues_I2C_RX(uint16_t device_address_, uint8_t *buffer_, uint16_t requested_byte_count_, uint32_t *available_);
+	static void attn_isr(void);
 
 	uint8_t _deviceAddress;
+
+	/** Classification of the last request result */
+	blues_err_class _last_err = BLUES_ERR_NONE;
+	/** Copy of the last "err" string from the Notecard */
+	char _last_err_str[BLUES_ERR_STR_SIZE] = {0};
+
+	/** Current request can be repeated without side effects */
+	bool _idempotent = true;
+	/** Current request is a command without response */
+	bool _is_cmd = false;
+	/** Current request is a note.add, counted by the sync scheduler */
+	bool _is_note = false;
+	/** Max number of tries per request */
+	uint8_t _retry_tries = BLUES_RETRY_TRIES;
+	/** Delay before the first retry */
+	uint16_t _retry_base_ms = BLUES_RETRY_BASE_MS;
+	/** Max delay between two tries */
+	uint16_t _retry_max_ms = BLUES_RETRY_MAX_MS;
+	/** State of the random generator for the retry jitter */
+	uint32_t _rand_state = 0;
+
+	/** Binary payload, Base64 encoded when the request is serialized */
+	const uint8_t *_payload = NULL;
+	/** Length of the binary payload */
+	size_t _payload_len = 0;
+
+	/** Bytes of serialized requests queued in in_out_buff by batch_add() */
+	size_t _batch_len = 0;
+	/** Number of queued requests and commands */
+	uint8_t _batch_count = 0;
+	/** Bit n is set if entry n of the batch is a request with response */
+	uint32_t _batch_rsp_mask = 0;
+	/** All queued entries can be repeated without side effects */
+	bool _batch_idempotent = true;
+	/** Bit n is set if entry n of the last sent batch succeeded */
+	uint32_t _batch_ok_mask = 0;
+
+	/** Configuration state of the running configuration pass */
+	blues_config_state *_cfg_state = NULL;
+	/** Configuration state changed and should be saved */
+	bool _cfg_changed = false;
+	/** Bit n is set if entry n of the batch is a setting */
+	uint32_t _cfg_mask = 0;
+	/** Setting slot of each batch entry */
+	uint8_t _cfg_slot[BLUES_BATCH_MAX];
+	/** Hash of each batch entry */
+	uint32_t _cfg_hash[BLUES_BATCH_MAX];
+
+	/** Pipelined requests in flight */
+	blues_pipe_entry _pipe[BLUES_PIPE_MAX];
+	/** Number of pipelined requests in flight */
+	uint8_t _pipe_count = 0;
+	/** Next "id" for a pipelined request */
+	uint32_t _pipe_next_id = 1;
+	/** Bytes of incomplete responses kept at the start of in_out_buff */
+	size_t _pipe_rx_len = 0;
+
+	/** Ping-pong request slots, two slots supplied by the application with slot_begin() */
+	blues_slot *_slots = NULL;
+	/** Slot for the next queued request */
+	uint8_t _slot_next = 0;
+	/** Queue order of the next request */
+	uint32_t _slot_seq = 0;
+
+	/** Ring buffer of samples, header and serialized body of each sample, supplied with sample_begin() */
+	uint8_t *_sample_buff = NULL;
+	/** Size of the sample buffer */
+	size_t _sample_size = 0;
+	/** Notefile for the samples */
+	char _sample_file[32] = "data.qo";
+	/** Flush as one note per sample in a batch instead of one note with an array */
+	bool _sample_burst = false;
+	/** Sync with NoteHub after each flush */
+	bool _sample_sync = false;
+	/** Position of the oldest sample */
+	size_t _sample_head = 0;
+	/** Position for the next sample */
+	size_t _sample_tail = 0;
+	/** End of the samples at the top of the buffer while new samples continue at the start */
+	size_t _sample_end = 0;
+	/** New samples continue at the start of the buffer */
+	bool _sample_wrapped = false;
+	/** Number of samples in the buffer, including sent ones waiting for removal */
+	uint16_t _sample_count = 0;
+	/** Number of samples not sent yet */
+	uint16_t _sample_pending = 0;
+	/** Serialized size of the samples not sent yet */
+	size_t _sample_bytes = 0;
+	/** Flush threshold, number of samples */
+	uint16_t _sample_max_count = 0;
+	/** Flush threshold, serialized size of the samples */
+	size_t _sample_max_bytes = 0;
+	/** Flush threshold, age of the oldest sample */
+	uint32_t _sample_max_age_ms = 0;
+
+	/** Records from sample_push(), written by the producer and read by sample_drain(), supplied with sample_isr_begin() */
+	blues_isr_sample *_isr_ring = NULL;
+	/** Number of records in the ring, a power of 2, 0 without ring */
+	uint16_t _isr_ring_size = 0;
+	/** Count of records read, only written by sample_drain() */
+	volatile uint16_t _isr_head = 0;
+	/** Count of records pushed, only written by sample_push() */
+	volatile uint16_t _isr_tail = 0;
+	/** Records dropped because the ring was full */
+	volatile uint32_t _isr_dropped = 0;
+	/** Body field names of the record values */
+	const char *const *_isr_fields = NULL;
+	/** Number of body field names */
+	uint8_t _isr_field_count = 0;
+
+	/** Sync policy, max time a note waits for a sync */
+	uint32_t _sync_max_delay_ms = 0;
+	/** Sync policy, max number of notes waiting for a sync */
+	uint16_t _sync_max_pending = 0;
+	/** Number of notes added since the last sync */
+	uint16_t _sync_pending = 0;
+	/** Time the first note after the last sync was added */
+	uint32_t _sync_first_ms = 0;
+	/** Time the last note was added */
+	uint32_t _sync_last_ms = 0;
+	/** An urgent note waits for a sync */
+	bool _sync_urgent = false;
+
+	/** Template registry */
+	blues_template _tpl[BLUES_TEMPLATE_MAX];
+	/** Number of templates in the registry */
+	uint8_t _tpl_count = 0;
+
+	/** Cached requests */
+	blues_cache_rule _cache_rules[BLUES_CACHE_RULES] = {};
+	/** Number of cached requests */
+	uint8_t _cache_rule_count = 0;
+	/** Cached responses, supplied with cache_begin() */
+	blues_cache_entry *_cache_entries = NULL;
+	/** Number of cached responses */
+	uint8_t _cache_entry_count = 0;
+
+	/** Clock, NoteCard time at _time_base_ms */
+	uint32_t _time_base_s = 0;
+	/** Clock, millis() when the NoteCard time was read */
+	uint32_t _time_base_ms = 0;
+	/** Clock, time of the last card.time request */
+	uint32_t _time_try_ms = 0;
+	/** Clock, interval to get card.time again, 0 to never resync */
+	uint32_t _time_resync_ms = 0;
+	/** Measured drift of millis() in ppm */
+	int32_t _time_drift_ppm = 0;
+	/** Drift was measured at least once */
+	bool _time_drift_known = false;
+	/** Clock is set */
+	bool _time_valid = false;
+	/** Add "time" to the samples */
+	bool _time_stamp_samples = false;
+
+	/** Cached location fix */
+	blues_location _loc = {};
+	/** millis() at the time of the cached fix */
+	uint32_t _loc_ms = 0;
+	/** Max age of a fix returned from the cache */
+	uint32_t _loc_max_age_ms = 0;
+	/** GNSS sampling interval while waiting for a fix, 0 for continuous mode */
+	uint32_t _loc_gnss_s = 0;
+	/** GNSS was switched on by the location service */
+	bool _loc_gnss_on = false;
+
+	/** I2C clock restored after a bus restart, 0 for the Wire default */
+	uint32_t _i2c_clock = 0;
+	/** Number of I2C bus recoveries */
+	uint32_t _i2c_recoveries = 0;
+	/** Number of failed I2C transfers, counted once after all tries */
+	uint32_t _i2c_errors = 0;
+	/** Number of failed I2C transfers when the clock was set */
+	uint32_t _i2c_clock_errors = 0;
+
+#if BLUES_USE_RTOS > 0
+	/** Requests for the worker task */
+	QueueHandle_t _worker_queue = NULL;
+	/** Held by the worker task or by a task with worker_lock() */
+	SemaphoreHandle_t _worker_mutex = NULL;
+#endif
+
+	/** Last completed download was checked against the MD5 */
+	bool _download_verified = false;
+
+	/** Result of the last presence check */
+	bool _ping_ok = false;
+	/** Time of the last presence check, 0 if never checked */
+	uint32_t _ping_ms = 0;
+
+	/** Position in the NoteCard binary buffer for the next binary_put() */
+	size_t _bin_offset = 0;
+
+	/** GPIO connected to the NoteCard ATTN pin, -1 if not used */
+	int16_t _attn_pin = -1;
+	/** Events armed with attn_arm() */
+	uint8_t _attn_events = 0;
+	/** Set by the ATTN interrupt, there is only one ATTN interrupt */
+	static volatile bool _attn_fired;
+	/** Application callback for the ATTN interrupt */
+	static void (*_attn_cb)(void);
 };
 #endif // _BLUES_MINIMAL_I2C_H_
\ No newline at end of file